@@ -0,0 +1,96 @@
+#ifndef LRU_STDLRUMAP_H
+#define LRU_STDLRUMAP_H
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+/**
+ * Baseline of the benchmarks: the textbook LRU cache, a std::list of the
+ *     entries in recency order indexed by a std::unordered_map.  It has the
+ *     interface of EvictingCacheMap the benchmarks use, with the same
+ *     eviction and promotion rules.
+ */
+template <class TKey, class TValue, class THash = std::hash<TKey>>
+class StdLruMap final {
+public:
+    using list_type = std::list<std::pair<TKey, TValue>>;
+    using iterator = typename list_type::iterator;
+
+    explicit StdLruMap(std::size_t capacity, const THash & hash = THash())
+            : capacity(capacity), index(0, hash) {
+    }
+
+    StdLruMap(const StdLruMap &) = delete;
+    StdLruMap & operator=(const StdLruMap &) = delete;
+
+    std::optional<TValue> get(const TKey & key) {
+        auto it = find(key);
+        if (it == end())
+            return {};
+
+        return it->second;
+    }
+
+    iterator find(const TKey & key) {
+        auto it = index.find(key);
+        if (it == index.end())
+            return end();
+
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second;
+    }
+
+    bool erase(const TKey & key) {
+        auto it = index.find(key);
+        if (it == index.end())
+            return false;
+
+        entries.erase(it->second);
+        index.erase(it);
+        return true;
+    }
+
+    void put(const TKey & key, const TValue & value) {
+        auto it = index.find(key);
+        if (it != index.end()) {
+            it->second->second = value;
+            entries.splice(entries.begin(), entries, it->second);
+            return;
+        }
+
+        if (entries.size() >= capacity) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+
+        entries.emplace_front(key, value);
+        index.emplace(key, entries.begin());
+    }
+
+    std::size_t size() const noexcept {
+        return entries.size();
+    }
+
+    void rehash(std::size_t count) {
+        index.rehash(count);
+    }
+
+    std::size_t bucket_count() const noexcept {
+        return index.bucket_count();
+    }
+
+    iterator end() noexcept {
+        return entries.end();
+    }
+
+private:
+    std::size_t capacity;
+    list_type entries;
+    std::unordered_map<TKey, iterator, THash> index;
+};
+
+#endif //LRU_STDLRUMAP_H
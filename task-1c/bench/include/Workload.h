@@ -0,0 +1,158 @@
+#ifndef LRU_WORKLOAD_H
+#define LRU_WORKLOAD_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+/**
+ * Access patterns of the benchmarks.  Each draws key ids from a universe
+ *     twice as large as the capacity of the cache, so that none of them
+ *     fits it whole.
+ */
+enum class Distribution {
+    UNIFORM,    //  every key equally likely
+    ZIPFIAN,    //  skewed popularity with exponent 0.99, as in YCSB
+    SCAN,       //  zipfian traffic interrupted by one-pass sweeps of the universe
+    LOOP        //  a cycle over 1.25 times the capacity, which LRU always misses
+};
+
+const Distribution DISTRIBUTIONS[] = {
+        Distribution::UNIFORM, Distribution::ZIPFIAN, Distribution::SCAN, Distribution::LOOP };
+
+inline const char * distributionName(Distribution distribution) {
+    switch (distribution) {
+        case Distribution::UNIFORM:
+            return "uniform";
+        case Distribution::ZIPFIAN:
+            return "zipf";
+        case Distribution::SCAN:
+            return "scan";
+        case Distribution::LOOP:
+            return "loop";
+    }
+
+    return "?";
+}
+
+/**
+ * Generator of zipfian ranks in [0, n), rank 0 the most popular, after Gray
+ *     et al., "Quickly generating billion-record synthetic databases": the
+ *     setup is linear in n, every draw constant.
+ */
+class ZipfianGenerator final {
+public:
+    /**
+     * Construct a ZipfianGenerator
+     * @param n number of ranks, at least 2
+     * @param theta skew in (0, 1), the larger the more skewed
+     */
+    explicit ZipfianGenerator(std::size_t n, double theta = 0.99)
+            : n(n), theta(theta), alpha(1.0 / (1.0 - theta)), zetan(zeta(n, theta)) {
+        eta = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta(2, theta) / zetan);
+    }
+
+    template <class TRandom>
+    std::size_t operator()(TRandom & random) {
+        double u = std::uniform_real_distribution<double>(0.0, 1.0)(random);
+        double uz = u * zetan;
+
+        if (uz < 1.0)
+            return 0;
+
+        if (uz < 1.0 + std::pow(0.5, theta))
+            return 1;
+
+        auto rank = static_cast<std::size_t>(n * std::pow(eta * u - eta + 1.0, alpha));
+        return (rank < n) ? rank : n - 1;
+    }
+
+private:
+    std::size_t n;
+    double theta;
+    double alpha;
+    double zetan;
+    double eta;
+
+    static double zeta(std::size_t n, double theta) {
+        double sum = 0.0;
+        for (std::size_t i = 1; i <= n; ++i) {
+            sum += 1.0 / std::pow(static_cast<double>(i), theta);
+        }
+
+        return sum;
+    }
+};
+
+/**
+ * Number of key ids a workload for a capacity draws from
+ */
+inline std::size_t keyRange(std::size_t capacity) {
+    return 2 * capacity;
+}
+
+/**
+ * Make a sequence of key ids in [0, keyRange(capacity)).  The zipfian ranks
+ *     are shuffled over the ids, so that the popular keys do not sit next to
+ *     each other in the hash table.
+ * @param distribution access pattern
+ * @param capacity capacity of the cache the workload is meant for
+ * @param length number of accesses
+ * @param seed seed of the random generator, for repeatable runs
+ * @return the key ids, in access order
+ */
+inline std::vector<std::uint32_t> makeWorkload(Distribution distribution, std::size_t capacity,
+                                               std::size_t length, unsigned seed) {
+    std::mt19937_64 random(seed);
+    auto range = keyRange(capacity);
+
+    std::vector<std::uint32_t> ids(range);
+    std::iota(ids.begin(), ids.end(), 0);
+    std::shuffle(ids.begin(), ids.end(), random);
+
+    std::vector<std::uint32_t> result(length);
+    switch (distribution) {
+        case Distribution::UNIFORM: {
+            std::uniform_int_distribution<std::size_t> uniform(0, range - 1);
+            for (auto & id : result) {
+                id = ids[uniform(random)];
+            }
+            break;
+        }
+        case Distribution::ZIPFIAN: {
+            ZipfianGenerator zipfian(range);
+            for (auto & id : result) {
+                id = ids[zipfian(random)];
+            }
+            break;
+        }
+        case Distribution::SCAN: {
+            //  a sweep of half the capacity every two capacities of accesses
+            ZipfianGenerator zipfian(range);
+            std::size_t cursor = 0;
+            for (std::size_t i = 0; i < length; ++i) {
+                if (i % (2 * capacity) < capacity / 2)
+                    result[i] = static_cast<std::uint32_t>(cursor++ % range);
+                else
+                    result[i] = ids[zipfian(random)];
+            }
+            break;
+        }
+        case Distribution::LOOP: {
+            auto loop = capacity + capacity / 4;
+            for (std::size_t i = 0; i < length; ++i) {
+                result[i] = static_cast<std::uint32_t>(i % loop);
+            }
+            break;
+        }
+    }
+
+    return result;
+}
+
+#endif //LRU_WORKLOAD_H
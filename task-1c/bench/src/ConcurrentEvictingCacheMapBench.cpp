@@ -0,0 +1,93 @@
+#include <memory>
+#include <mutex>
+#include <random>
+
+#include <benchmark/benchmark.h>
+
+#include <ConcurrentEvictingCacheMap.h>
+
+//  Throughput of a shared cache under a 90% get / 10% put mix of uniform
+//  keys, twice as many as the capacity.  Items per second should grow close
+//  to linearly with the thread count for the sharded map, and flatten out
+//  for an EvictingCacheMap behind one mutex.
+
+namespace {
+
+const std::size_t CAPACITY = 1 << 16;
+const int KEY_RANGE = 2 * CAPACITY;
+
+class GlobalMutexMap final {
+public:
+    explicit GlobalMutexMap(std::size_t capacity)
+            : map(capacity) {
+    }
+
+    std::optional<int> get(int key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return map.get(key);
+    }
+
+    void put(int key, int value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        map.put(key, value);
+    }
+
+private:
+    std::mutex mutex;
+    EvictingCacheMap<int, int> map;
+};
+
+std::unique_ptr<ConcurrentEvictingCacheMap<int, int>> shardedMap;
+std::unique_ptr<GlobalMutexMap> globalMap;
+
+//  the map is only dereferenced inside the loop, whose start waits for thread 0
+//  to have built it
+template <class TMap>
+void runMix(benchmark::State & state, const std::unique_ptr<TMap> & map) {
+    std::mt19937 random(static_cast<unsigned>(state.thread_index()) + 1);
+    std::uniform_int_distribution<int> keys(0, KEY_RANGE - 1);
+    std::uniform_int_distribution<int> ops(0, 9);
+
+    for (auto _ : state) {
+        auto key = keys(random);
+        if (ops(random) == 0)
+            map->put(key, key);
+        else
+            benchmark::DoNotOptimize(map->get(key));
+    }
+
+    state.SetItemsProcessed(state.iterations());
+}
+
+}   //  namespace
+
+static void BM_ConcurrentMix(benchmark::State & state) {
+    if (state.thread_index() == 0) {
+        shardedMap = std::make_unique<ConcurrentEvictingCacheMap<int, int>>(
+                CAPACITY, static_cast<std::size_t>(state.range(0)));
+        for (int i = 0; i < static_cast<int>(CAPACITY); ++i) {
+            shardedMap->put(i, i);
+        }
+    }
+
+    runMix(state, shardedMap);
+
+    if (state.thread_index() == 0)
+        shardedMap.reset();
+}
+BENCHMARK(BM_ConcurrentMix)->Arg(64)->ThreadRange(1, 32)->UseRealTime();
+
+static void BM_GlobalMutexMix(benchmark::State & state) {
+    if (state.thread_index() == 0) {
+        globalMap = std::make_unique<GlobalMutexMap>(CAPACITY);
+        for (int i = 0; i < static_cast<int>(CAPACITY); ++i) {
+            globalMap->put(i, i);
+        }
+    }
+
+    runMix(state, globalMap);
+
+    if (state.thread_index() == 0)
+        globalMap.reset();
+}
+BENCHMARK(BM_GlobalMutexMix)->ThreadRange(1, 32)->UseRealTime();
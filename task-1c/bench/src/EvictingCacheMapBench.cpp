@@ -0,0 +1,82 @@
+#include <memory>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <EvictingCacheMap.h>
+
+//  Lookups of uniform keys in batches of 256, one get() after another or
+//  with one multiGet().  With the map far larger than the last level cache
+//  most lookups miss it on the bucket, the slot and the slots promotion
+//  relinks: multiGet() issues those misses for 16 keys at a time, so its
+//  items per second should be higher there on hardware which keeps several
+//  misses in flight, and about the same for a map which fits in the cache.
+
+namespace {
+
+const std::size_t BATCH = 256;
+
+std::unique_ptr<EvictingCacheMap<int, int>> batchMap;
+
+std::vector<int> batchKeys(std::size_t capacity, unsigned seed) {
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> keys(0, static_cast<int>(capacity) - 1);
+
+    std::vector<int> result(BATCH * 4096);
+    for (auto & key : result) {
+        key = keys(random);
+    }
+
+    return result;
+}
+
+EvictingCacheMap<int, int> & filledMap(std::size_t capacity) {
+    if (!batchMap || batchMap->size() != capacity) {
+        batchMap = std::make_unique<EvictingCacheMap<int, int>>(capacity, PREALLOCATE);
+        for (int i = 0; i < static_cast<int>(capacity); ++i) {
+            batchMap->put(i, i);
+        }
+    }
+
+    return *batchMap;
+}
+
+}   //  namespace
+
+static void BM_GetLoop(benchmark::State & state) {
+    auto capacity = static_cast<std::size_t>(state.range(0));
+    auto & map = filledMap(capacity);
+    auto keys = batchKeys(capacity, 1);
+
+    std::vector<std::optional<int>> values(BATCH);
+    std::size_t offset = 0;
+    for (auto _ : state) {
+        for (std::size_t i = 0; i < BATCH; ++i) {
+            values[i] = map.get(keys[offset + i]);
+        }
+        benchmark::DoNotOptimize(values.data());
+        offset = (offset + BATCH) % keys.size();
+    }
+
+    state.SetItemsProcessed(state.iterations() * BATCH);
+}
+BENCHMARK(BM_GetLoop)->Arg(1 << 12)->Arg(1 << 24);
+
+static void BM_MultiGet(benchmark::State & state) {
+    auto capacity = static_cast<std::size_t>(state.range(0));
+    auto & map = filledMap(capacity);
+    auto keys = batchKeys(capacity, 1);
+
+    std::vector<std::optional<int>> values(BATCH);
+    std::size_t offset = 0;
+    for (auto _ : state) {
+        map.multiGet(keys.begin() + offset, keys.begin() + offset + BATCH, values.begin());
+        benchmark::DoNotOptimize(values.data());
+        offset = (offset + BATCH) % keys.size();
+    }
+
+    state.SetItemsProcessed(state.iterations() * BATCH);
+}
+BENCHMARK(BM_MultiGet)->Arg(1 << 12)->Arg(1 << 24);
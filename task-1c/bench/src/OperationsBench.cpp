@@ -0,0 +1,302 @@
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <EvictingCacheMap.h>
+#include <StdLruMap.h>
+#include <Workload.h>
+
+//  Throughput and latency of the single operations, for every combination of
+//  operation, map, key and value type, access pattern and capacity, named
+//  BM_<operation>/<map>/<types>/<pattern>/<capacity>.  Each iteration runs a
+//  batch of operations: items_per_second is the throughput, latency the mean
+//  time of one operation, hit_ratio the share of lookups which found their
+//  key.  StdLruMap, the textbook std::unordered_map + std::list cache, is the
+//  baseline EvictingCacheMap should beat everywhere.  Access is the use of a
+//  read-through cache, a get() and a put() on a miss, whose hit ratio is the
+//  one of the eviction policy: 0 for LRU under the loop pattern.  Rehash is
+//  the cost of doubling the bucket count of a full map, per entry.
+//
+//  The caches are warmed up with the whole access sequence before they are
+//  measured, so they hold what the pattern keeps in them.
+
+namespace {
+
+const std::size_t BATCH = 1024;
+const std::size_t SEQUENCE_LENGTH = 1 << 20;
+const unsigned SEED = 42;
+
+const std::size_t CAPACITIES[] = { 1 << 10, 1 << 14, 1 << 18 };
+
+struct IntKeys final {
+    using key_type = int;
+    using value_type = int;
+
+    static constexpr const char * NAME = "int";
+
+    static key_type key(std::uint32_t id) {
+        return static_cast<key_type>(id);
+    }
+
+    static value_type value(std::size_t i) {
+        return static_cast<value_type>(i);
+    }
+};
+
+//  keys too long for the small string optimization, as most real ones
+struct StringKeys final {
+    using key_type = std::string;
+    using value_type = int;
+
+    static constexpr const char * NAME = "string";
+
+    static key_type key(std::uint32_t id) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "session:%016x", static_cast<unsigned>(id));
+        return buffer;
+    }
+
+    static value_type value(std::size_t i) {
+        return static_cast<value_type>(i);
+    }
+};
+
+struct LargeValue final {
+    std::array<std::uint64_t, 32> words;
+};
+
+struct LargeValues final {
+    using key_type = int;
+    using value_type = LargeValue;
+
+    static constexpr const char * NAME = "large";
+
+    static key_type key(std::uint32_t id) {
+        return static_cast<key_type>(id);
+    }
+
+    static value_type value(std::size_t i) {
+        LargeValue result{};
+        result.words[0] = i;
+        return result;
+    }
+};
+
+template <class TCase>
+using Evicting = EvictingCacheMap<typename TCase::key_type, typename TCase::value_type>;
+
+template <class TCase>
+using Baseline = StdLruMap<typename TCase::key_type, typename TCase::value_type>;
+
+template <class TCase>
+std::vector<typename TCase::key_type> keySequence(Distribution distribution, std::size_t capacity) {
+    std::vector<typename TCase::key_type> result;
+    result.reserve(SEQUENCE_LENGTH);
+
+    for (auto id : makeWorkload(distribution, capacity, SEQUENCE_LENGTH, SEED)) {
+        result.push_back(TCase::key(id));
+    }
+
+    return result;
+}
+
+template <class TCase, class TMap>
+void warmUp(TMap & map, const std::vector<typename TCase::key_type> & keys) {
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        map.put(keys[i], TCase::value(i));
+    }
+}
+
+template <class TKey, class TValue>
+void doubleBuckets(EvictingCacheMap<TKey, TValue> & map) {
+    map.max_load_factor(map.max_load_factor() / 2);
+}
+
+template <class TKey, class TValue>
+void doubleBuckets(StdLruMap<TKey, TValue> & map) {
+    map.rehash(2 * map.bucket_count());
+}
+
+void report(benchmark::State & state, std::size_t batch) {
+    state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * batch));
+    state.counters["latency"] = benchmark::Counter(static_cast<double>(batch),
+            benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+
+void reportHits(benchmark::State & state, std::size_t hits) {
+    state.counters["hit_ratio"] = static_cast<double>(hits) / (state.iterations() * BATCH);
+}
+
+template <class TMap, class TCase>
+void BM_Put(benchmark::State & state, Distribution distribution, std::size_t capacity) {
+    auto keys = keySequence<TCase>(distribution, capacity);
+    TMap map(capacity);
+    warmUp<TCase>(map, keys);
+
+    std::size_t offset = 0;
+    for (auto _ : state) {
+        for (std::size_t i = offset; i < offset + BATCH; ++i) {
+            map.put(keys[i], TCase::value(i));
+        }
+        offset = (offset + BATCH) % keys.size();
+    }
+
+    report(state, BATCH);
+}
+
+template <class TMap, class TCase>
+void BM_Get(benchmark::State & state, Distribution distribution, std::size_t capacity) {
+    auto keys = keySequence<TCase>(distribution, capacity);
+    TMap map(capacity);
+    warmUp<TCase>(map, keys);
+
+    std::size_t offset = 0;
+    std::size_t hits = 0;
+    for (auto _ : state) {
+        for (std::size_t i = offset; i < offset + BATCH; ++i) {
+            auto value = map.get(keys[i]);
+            hits += value.has_value();
+            benchmark::DoNotOptimize(value);
+        }
+        offset = (offset + BATCH) % keys.size();
+    }
+
+    report(state, BATCH);
+    reportHits(state, hits);
+}
+
+//  get(), then put() on a miss
+template <class TMap, class TCase>
+void BM_Access(benchmark::State & state, Distribution distribution, std::size_t capacity) {
+    auto keys = keySequence<TCase>(distribution, capacity);
+    TMap map(capacity);
+    warmUp<TCase>(map, keys);
+
+    std::size_t offset = 0;
+    std::size_t hits = 0;
+    for (auto _ : state) {
+        for (std::size_t i = offset; i < offset + BATCH; ++i) {
+            auto value = map.get(keys[i]);
+            if (value)
+                ++hits;
+            else
+                map.put(keys[i], TCase::value(i));
+            benchmark::DoNotOptimize(value);
+        }
+        offset = (offset + BATCH) % keys.size();
+    }
+
+    report(state, BATCH);
+    reportHits(state, hits);
+}
+
+//  as get(), without copying the value out
+template <class TMap, class TCase>
+void BM_Find(benchmark::State & state, Distribution distribution, std::size_t capacity) {
+    auto keys = keySequence<TCase>(distribution, capacity);
+    TMap map(capacity);
+    warmUp<TCase>(map, keys);
+
+    std::size_t offset = 0;
+    std::size_t hits = 0;
+    for (auto _ : state) {
+        for (std::size_t i = offset; i < offset + BATCH; ++i) {
+            auto it = map.find(keys[i]);
+            if (it != map.end()) {
+                ++hits;
+                benchmark::DoNotOptimize(it->second);
+            }
+        }
+        offset = (offset + BATCH) % keys.size();
+    }
+
+    report(state, BATCH);
+    reportHits(state, hits);
+}
+
+//  the erased keys are put back out of the measure, so the map stays full
+template <class TMap, class TCase>
+void BM_Erase(benchmark::State & state, Distribution distribution, std::size_t capacity) {
+    auto keys = keySequence<TCase>(distribution, capacity);
+    TMap map(capacity);
+    warmUp<TCase>(map, keys);
+
+    std::size_t offset = 0;
+    std::size_t hits = 0;
+    for (auto _ : state) {
+        for (std::size_t i = offset; i < offset + BATCH; ++i) {
+            hits += map.erase(keys[i]);
+        }
+
+        state.PauseTiming();
+        for (std::size_t i = offset; i < offset + BATCH; ++i) {
+            map.put(keys[i], TCase::value(i));
+        }
+        offset = (offset + BATCH) % keys.size();
+        state.ResumeTiming();
+    }
+
+    report(state, BATCH);
+    reportHits(state, hits);
+}
+
+template <class TMap, class TCase>
+void BM_Rehash(benchmark::State & state, std::size_t capacity) {
+    for (auto _ : state) {
+        state.PauseTiming();
+        TMap map(capacity);
+        for (std::uint32_t id = 0; id < capacity; ++id) {
+            map.put(TCase::key(id), TCase::value(id));
+        }
+        state.ResumeTiming();
+
+        doubleBuckets(map);
+        benchmark::DoNotOptimize(map);
+    }
+
+    report(state, capacity);
+}
+
+template <class TMap, class TCase>
+void registerMap(const std::string & mapName) {
+    auto types = mapName + "/" + TCase::NAME + "/";
+
+    for (auto capacity : CAPACITIES) {
+        auto suffix = "/" + std::to_string(capacity);
+
+        for (auto distribution : DISTRIBUTIONS) {
+            auto name = types + distributionName(distribution) + suffix;
+
+            benchmark::RegisterBenchmark(("BM_Put/" + name).c_str(),
+                    BM_Put<TMap, TCase>, distribution, capacity);
+            benchmark::RegisterBenchmark(("BM_Get/" + name).c_str(),
+                    BM_Get<TMap, TCase>, distribution, capacity);
+            benchmark::RegisterBenchmark(("BM_Find/" + name).c_str(),
+                    BM_Find<TMap, TCase>, distribution, capacity);
+            benchmark::RegisterBenchmark(("BM_Erase/" + name).c_str(),
+                    BM_Erase<TMap, TCase>, distribution, capacity);
+            benchmark::RegisterBenchmark(("BM_Access/" + name).c_str(),
+                    BM_Access<TMap, TCase>, distribution, capacity);
+        }
+
+        benchmark::RegisterBenchmark(("BM_Rehash/" + types.substr(0, types.size() - 1) + suffix).c_str(),
+                BM_Rehash<TMap, TCase>, capacity);
+    }
+}
+
+template <class TCase>
+void registerCase() {
+    registerMap<Evicting<TCase>, TCase>("EvictingCacheMap");
+    registerMap<Baseline<TCase>, TCase>("StdLruMap");
+}
+
+const bool REGISTERED = (registerCase<IntKeys>(),
+        registerCase<StringKeys>(),
+        registerCase<LargeValues>(),
+        true);
+
+}   //  namespace
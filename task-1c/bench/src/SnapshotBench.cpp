@@ -0,0 +1,73 @@
+#include <cstdio>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include <EvictingCacheMap.h>
+
+//  Saving and loading a full map of 2^22 int entries, against rebuilding it
+//  with put().  bytes_per_second is measured on the file, read from the page
+//  cache: loading is bound by the random writes of the index build, and
+//  should be several times faster than the put() loop.
+
+namespace {
+
+const std::size_t CAPACITY = 1 << 22;
+
+std::string snapshotPath() {
+    return "bench_lru.snapshot";
+}
+
+EvictingCacheMap<int, int> filledMap() {
+    EvictingCacheMap<int, int> map(CAPACITY);
+    for (int i = 0; i < static_cast<int>(CAPACITY); ++i) {
+        map.put(i * 7919, i);
+    }
+
+    return map;
+}
+
+std::size_t snapshotBytes() {
+    return sizeof(SnapshotHeader) + CAPACITY * 2 * sizeof(int);
+}
+
+}   //  namespace
+
+static void BM_SaveSnapshot(benchmark::State & state) {
+    auto map = filledMap();
+
+    for (auto _ : state) {
+        map.saveSnapshot(snapshotPath());
+    }
+
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * snapshotBytes()));
+    std::remove(snapshotPath().c_str());
+}
+BENCHMARK(BM_SaveSnapshot)->Unit(benchmark::kMillisecond);
+
+static void BM_LoadSnapshot(benchmark::State & state) {
+    filledMap().saveSnapshot(snapshotPath());
+    EvictingCacheMap<int, int> map(CAPACITY);
+
+    for (auto _ : state) {
+        map.loadSnapshot(snapshotPath());
+    }
+
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * snapshotBytes()));
+    std::remove(snapshotPath().c_str());
+}
+BENCHMARK(BM_LoadSnapshot)->Unit(benchmark::kMillisecond);
+
+//  what a warm restart costs without a snapshot, even with the entries at hand
+static void BM_PutAll(benchmark::State & state) {
+    for (auto _ : state) {
+        EvictingCacheMap<int, int> map(CAPACITY);
+        for (int i = 0; i < static_cast<int>(CAPACITY); ++i) {
+            map.put(i * 7919, i);
+        }
+        benchmark::DoNotOptimize(map);
+    }
+
+    state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * snapshotBytes()));
+}
+BENCHMARK(BM_PutAll)->Unit(benchmark::kMillisecond);
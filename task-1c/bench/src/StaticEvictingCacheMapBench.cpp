@@ -0,0 +1,47 @@
+#include <benchmark/benchmark.h>
+
+#include <EvictingCacheMap.h>
+#include <StaticEvictingCacheMap.h>
+
+//  Short-lived memoization caches, as made per connection or per request:
+//  create a map of 8 or 64 entries, do 32 lookups and puts over 48 keys, drop
+//  it.  StaticEvictingCacheMap costs no allocation; EvictingCacheMap pays for
+//  its slot array and index on the first puts, and frees them at the end.
+
+namespace {
+
+const int OPERATIONS = 32;
+const int KEYS = 48;
+
+template <class TMap>
+void memoize(TMap & map) {
+    for (int i = 0; i < OPERATIONS; ++i) {
+        auto key = (i * 29) % KEYS;
+        if (map.find(key) == map.end())
+            map.put(key, key * 3);
+    }
+}
+
+}   //  namespace
+
+template <std::size_t N>
+static void BM_ShortLivedStatic(benchmark::State & state) {
+    for (auto _ : state) {
+        StaticEvictingCacheMap<int, int, N> map;
+        memoize(map);
+        benchmark::DoNotOptimize(map);
+    }
+}
+BENCHMARK_TEMPLATE(BM_ShortLivedStatic, 8);
+BENCHMARK_TEMPLATE(BM_ShortLivedStatic, 64);
+
+template <std::size_t N>
+static void BM_ShortLivedDynamic(benchmark::State & state) {
+    for (auto _ : state) {
+        EvictingCacheMap<int, int> map(N);
+        memoize(map);
+        benchmark::DoNotOptimize(map);
+    }
+}
+BENCHMARK_TEMPLATE(BM_ShortLivedDynamic, 8);
+BENCHMARK_TEMPLATE(BM_ShortLivedDynamic, 64);
@@ -0,0 +1,239 @@
+#ifndef LRU_ASYNCLOADINGCACHE_H
+#define LRU_ASYNCLOADINGCACHE_H
+
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+#include "EvictingCacheMap.h"
+
+/**
+ * Cache which loads missing values in the background.  get() never blocks
+ *     on a load: it returns a std::shared_future, ready on a hit, and on a
+ *     miss starts the loader through an executor (e.g. a ThreadPool) and
+ *     returns the future of that load.
+ *
+ * Entries are the futures themselves, so a load in flight is found by every
+ *     get() of its key until it completes, and the loader runs once for all
+ *     of them.  A pending entry counts in the capacity and may be evicted
+ *     like any other; its callers still get their value, which is then not
+ *     cached.  A load which throws is dropped from the cache, and its
+ *     callers get the exception from their future; so is a load the
+ *     executor refuses, by throwing, or drops without running it.
+ *
+ * All operations take one mutex for the time of a map operation, never for
+ *     a load.  Loads keep the state of the cache alive, so the cache may be
+ *     destroyed while some are still running.
+ */
+template <class TKey, class TValue, class THash = std::hash<TKey>,
+        class TPolicy = LruPolicy>
+class AsyncLoadingCache final {
+public:
+    using future_type = std::shared_future<TValue>;
+    using loader_type = std::function<TValue(const TKey &)>;
+    using executor_type = std::function<void(std::function<void()>)>;
+
+    /**
+     * Construct an AsyncLoadingCache
+     * @param capacity maximum number of entries, loaded or loading
+     * @param loader function returning the value of a key; it runs on the
+     *     executor and may throw
+     * @param executor function running a task asynchronously, e.g. by
+     *     calling ThreadPool::execute()
+     * @param hash hash function for the keys
+     */
+    AsyncLoadingCache(std::size_t capacity, loader_type loader, executor_type executor,
+                      const THash & hash = THash())
+            : state(std::make_shared<State>(capacity, std::move(loader), hash)),
+              executor(std::move(executor)) {
+    }
+
+    AsyncLoadingCache(const AsyncLoadingCache &) = delete;
+    AsyncLoadingCache & operator=(const AsyncLoadingCache &) = delete;
+
+    /**
+     * Get the future value of a key, starting a load if it is neither cached
+     *     nor loading.  A found entry is promoted.
+     * @param key key associated with the value
+     * @return the future of the value; get() on it blocks until the load is
+     *     over and rethrows the exception of a failed load
+     */
+    future_type get(const TKey & key) {
+        std::shared_ptr<Load> load;
+        future_type future;
+
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+
+            auto it = state->map.find(key);
+            if (it != state->map.end())
+                return it->second.future;
+
+            //  a hit costs no allocation: the load is made on a miss only
+            load = std::make_shared<Load>(state, key);
+            load->number = ++state->loads;
+            future = load->promise.get_future().share();
+            state->map.put(key, Entry{ future, load->number });
+            load->pending = true;
+        }
+
+        //  a task the executor refuses fails the load, as a throwing loader
+        //  does, and so does one it drops without running it (see Load)
+        try {
+            executor([load] {
+                load->run();
+            });
+        } catch (...) {
+            load->fail(std::current_exception());
+        }
+
+        return future;
+    }
+
+    /**
+     * Get a copy of the value of a key if it is loaded, without loading it
+     *     nor promoting it
+     * @param key key associated with the value
+     * @return the value if it exists and its load is over
+     */
+    std::optional<TValue> getIfPresent(const TKey & key) const {
+        std::lock_guard<std::mutex> lock(state->mutex);
+
+        auto it = std::as_const(state->map).find(key);
+        if (it == state->map.cend() || !ready(it->second.future))
+            return {};
+
+        return it->second.future.get();
+    }
+
+    /**
+     * Set the value of a key, replacing its entry even if it is loading
+     * @param key key to associate with value
+     * @param value value to associate with the key
+     */
+    void put(const TKey & key, TValue value) {
+        std::promise<TValue> promise;
+        promise.set_value(std::move(value));
+
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->map.put(key, Entry{ promise.get_future().share(), ++state->loads });
+    }
+
+    /**
+     * Erase the entry of a key.  A load in flight still completes for its
+     *     callers, but its value is not cached.
+     * @param key key associated with the value
+     * @return true if the key had an entry, else false
+     */
+    bool erase(const TKey & key) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        return state->map.erase(key);
+    }
+
+    /**
+     * Get the number of entries, loading ones included
+     * @return the size of the cache
+     */
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        return state->map.size();
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->map.clear();
+    }
+
+private:
+    /**
+     * A cached future, with the number of the load which made it to tell it
+     *     from a later entry of the same key
+     */
+    struct Entry final {
+        future_type future;
+        std::uint64_t load;
+    };
+
+    using map_type = EvictingCacheMap<TKey, Entry, THash, TPolicy>;
+
+    struct State final {
+        State(std::size_t capacity, loader_type loader, const THash & hash)
+                : map(capacity, hash), loader(std::move(loader)) {
+        }
+
+        std::mutex mutex;
+        map_type map;
+        std::uint64_t loads = 0;
+
+        const loader_type loader;
+    };
+
+    /**
+     * A load handed to the executor.  A failed load leaves the cache before
+     *     its callers see the exception, so that no get() returns a failed
+     *     future once they have.  A load the executor drops without running
+     *     it, e.g. when it shuts down, fails as well when its last copy is
+     *     destroyed: its callers get a broken_promise std::future_error.
+     */
+    struct Load final {
+        Load(std::shared_ptr<State> state, const TKey & key)
+                : state(std::move(state)), key(key) {
+        }
+
+        Load(const Load &) = delete;
+        Load & operator=(const Load &) = delete;
+
+        ~Load() {
+            if (pending)
+                forget();
+        }
+
+        void run() {
+            pending = false;
+
+            try {
+                promise.set_value(state->loader(key));
+            } catch (...) {
+                fail(std::current_exception());
+            }
+        }
+
+        void fail(std::exception_ptr error) {
+            pending = false;
+            forget();
+            promise.set_exception(error);
+        }
+
+        /**
+         * Erase the entry of the key if it is still the one of this load
+         */
+        void forget() {
+            std::lock_guard<std::mutex> lock(state->mutex);
+
+            auto it = std::as_const(state->map).find(key);
+            if (it != state->map.cend() && it->second.load == number)
+                state->map.erase(key);
+        }
+
+        std::shared_ptr<State> state;
+        const TKey key;
+        std::uint64_t number = 0;
+        std::promise<TValue> promise;
+        bool pending = false;       //  cached, neither run nor failed yet
+    };
+
+    std::shared_ptr<State> state;
+    executor_type executor;
+
+    static bool ready(const future_type & future) {
+        return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+};
+
+#endif //LRU_ASYNCLOADINGCACHE_H
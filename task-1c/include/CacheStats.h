@@ -0,0 +1,154 @@
+#ifndef LRU_CACHESTATS_H
+#define LRU_CACHESTATS_H
+
+#include <chrono>
+#include <cstdint>
+
+/**
+ * Snapshot of the statistics of a cache, as returned by stats().  The
+ *     counters stay at zero unless the cache counts them (see CountingStats);
+ *     the index figures are always there.
+ */
+struct CacheStats final {
+    std::uint64_t hits = 0;         //  lookups which found a live entry
+    std::uint64_t misses = 0;       //  lookups which did not
+    std::uint64_t promotions = 0;   //  hits applied to the eviction order
+    std::uint64_t insertions = 0;   //  new entries
+    std::uint64_t evictions = 0;    //  entries removed by the capacity or the weight
+    std::uint64_t expirations = 0;  //  entries removed by their time to live
+
+    std::uint64_t rehashes = 0;     //  times the index grew or was cleaned up
+    std::chrono::nanoseconds rehashTime{ 0 };   //  spent rehashing all at once
+
+    std::uint64_t probes = 0;       //  bucket groups probed to reach every indexed entry
+    std::uint64_t indexed = 0;      //  entries in the index
+
+    /**
+     * Ratio of hits to lookups, 0 without lookups
+     */
+    double hitRatio() const noexcept {
+        auto lookups = hits + misses;
+        return (lookups == 0) ? 0.0 : static_cast<double>(hits) / lookups;
+    }
+
+    /**
+     * Average number of bucket groups a lookup of an indexed key probes: 1
+     *     when its home group has room, more as the probe sequences get
+     *     longer
+     */
+    double averageProbeLength() const noexcept {
+        return (indexed == 0) ? 0.0 : static_cast<double>(probes) / indexed;
+    }
+
+    /**
+     * Add the figures of another cache, e.g. to sum up shards
+     */
+    CacheStats & operator+=(const CacheStats & other) noexcept {
+        hits += other.hits;
+        misses += other.misses;
+        promotions += other.promotions;
+        insertions += other.insertions;
+        evictions += other.evictions;
+        expirations += other.expirations;
+        rehashes += other.rehashes;
+        rehashTime += other.rehashTime;
+        probes += other.probes;
+        indexed += other.indexed;
+
+        return *this;
+    }
+};
+
+/**
+ * Default statistics policy of the caches: counts nothing, and its calls
+ *     compile to nothing
+ */
+struct NoStats final {
+    static constexpr const bool ENABLED = false;
+
+    void recordHit() noexcept {
+    }
+
+    void recordMiss() noexcept {
+    }
+
+    void recordPromotion() noexcept {
+    }
+
+    void recordInsertion() noexcept {
+    }
+
+    void recordEviction() noexcept {
+    }
+
+    void recordExpiration() noexcept {
+    }
+
+    void addTo(CacheStats &) const noexcept {
+    }
+
+    void clear() noexcept {
+    }
+};
+
+/**
+ * Statistics policy counting the events of a cache in plain integers, so
+ *     recording costs an increment.  The counters belong to the owner of the
+ *     cache like the rest of its state: ConcurrentEvictingCacheMap counts
+ *     its shared-lock reads apart, per thread stripe.
+ */
+class CountingStats final {
+public:
+    static constexpr const bool ENABLED = true;
+
+    void recordHit() noexcept {
+        ++hits;
+    }
+
+    void recordMiss() noexcept {
+        ++misses;
+    }
+
+    void recordPromotion() noexcept {
+        ++promotions;
+    }
+
+    void recordInsertion() noexcept {
+        ++insertions;
+    }
+
+    void recordEviction() noexcept {
+        ++evictions;
+    }
+
+    void recordExpiration() noexcept {
+        ++expirations;
+    }
+
+    /**
+     * Add the counters to a snapshot
+     * @param stats snapshot to add to
+     */
+    void addTo(CacheStats & stats) const noexcept {
+        stats.hits += hits;
+        stats.misses += misses;
+        stats.promotions += promotions;
+        stats.insertions += insertions;
+        stats.evictions += evictions;
+        stats.expirations += expirations;
+    }
+
+    void clear() noexcept {
+        *this = CountingStats();
+    }
+
+private:
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t promotions = 0;
+    std::uint64_t insertions = 0;
+    std::uint64_t evictions = 0;
+    std::uint64_t expirations = 0;
+};
+
+#endif //LRU_CACHESTATS_H
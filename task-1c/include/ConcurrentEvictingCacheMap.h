@@ -0,0 +1,572 @@
+#ifndef LRU_CONCURRENTEVICTINGCACHEMAP_H
+#define LRU_CONCURRENTEVICTINGCACHEMAP_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "EvictingCacheMap.h"
+#include "ReadBuffer.h"
+
+/**
+ * Thread-safe EvictingCacheMap.  The key space is split over a power-of-two
+ *     number of shards, each one an independent EvictingCacheMap with its own
+ *     lock and its own share of the capacity, so threads working on different
+ *     shards never wait for each other.
+ *
+ * Eviction is per shard: a put() evicts the victim the policy picks in its
+ *     shard (the least recently used entry of the shard with LruPolicy), not
+ *     in the whole map.
+ *
+ * Reads take the shard lock shared and do not promote on the spot: hits are
+ *     recorded in striped, lock-free read buffers and applied to the LRU in
+ *     batches, when a buffer fills up or before the next write to the shard.
+ *     Under heavy load some promotions are dropped, which only makes the LRU
+ *     order less precise.
+ *
+ * Every operation hashes its key once: the hash picks the shard, from its
+ *     high bits, and goes to the shard map with the key as a HashedKey.
+ *
+ * getOrCompute() loads missing values out of the lock, once per key however
+ *     many threads miss it at the same time: the first one runs the loader
+ *     and the others wait for its result (single flight).
+ *
+ * With a counting TStats the shard maps count their events, and the reads
+ *     under the shared lock count their hits and misses in relaxed atomics
+ *     striped by thread; stats() adds them all up.
+ */
+template <class TKey, class TValue, class THash = std::hash<TKey>,
+        class TPolicy = LruPolicy, class TStats = NoStats>
+class ConcurrentEvictingCacheMap final {
+public:
+    using map_type = EvictingCacheMap<TKey, TValue, THash, TPolicy, UnitWeigher,
+            std::chrono::steady_clock, TStats>;
+    using removal_listener = typename map_type::removal_listener;
+
+    static constexpr const std::size_t DEFAULT_SHARD_COUNT = 16;
+
+    /**
+     * Construct a ConcurrentEvictingCacheMap
+     * @param capacity maximum size of the whole map, split evenly (rounding
+     *     up) between the shards
+     * @param shardCount number of shards, rounded up to a power of two
+     * @param hash hash function for the keys
+     */
+    explicit ConcurrentEvictingCacheMap(std::size_t capacity,
+                                        std::size_t shardCount = DEFAULT_SHARD_COUNT,
+                                        const THash & hash = THash())
+            : hasher(hash) {
+        if (shardCount == 0)
+            throw std::invalid_argument("ConcurrentEvictingCacheMap needs at least one shard");
+
+        while ((std::size_t(1) << shardBits) < shardCount)
+            ++shardBits;
+
+        shardCount = std::size_t(1) << shardBits;
+        shardCapacity = (capacity + shardCount - 1) / shardCount;
+
+        shards = std::make_unique<Shard[]>(shardCount);
+        for (std::size_t i = 0; i < shardCount; ++i) {
+            shards[i].map = map_type(shardCapacity, hash);
+            shards[i].loading = loading_map(0, hash);
+        }
+    }
+
+    ConcurrentEvictingCacheMap(const ConcurrentEvictingCacheMap &) = delete;
+    ConcurrentEvictingCacheMap & operator=(const ConcurrentEvictingCacheMap &) = delete;
+
+    /**
+     * Check for existence of a specific key in the map.  This operation has
+     *     no effect on LRU order.
+     * @param key key to search for
+     * @return true if exists, false otherwise
+     */
+    bool exists(const TKey & key) const {
+        return containsKey(key);
+    }
+
+    /**
+     * Get a copy of the value associated with a specific key.  This function
+     *     always promotes a found value to the head of its shard LRU.
+     * @param key key associated with the value
+     * @return the value if it exists
+     */
+    std::optional<TValue> get(const TKey & key) {
+        return getKey(key);
+    }
+
+    /**
+     * Run a function on the value associated with a key, in place under the
+     *     shared shard lock rather than on a copy.  The hit is recorded as for
+     *     get().  The function must not use the map.
+     * @param key key associated with the value
+     * @param function function taking a const TValue &
+     * @return true if the key was found and the function called
+     */
+    template <class TVisit>
+    bool visit(const TKey & key, TVisit && function) {
+        return visitKey(key, function);
+    }
+
+    /**
+     * Set a key-value pair in the map
+     * @param key key to associate with value
+     * @param value value to associate with the key
+     */
+    template <class T, class E>
+    void put(T && key, E && value) {
+        auto hash = hasher(key);
+        write(shardOf(hash), [&](map_type & map) {
+            map.put(HashedKey<T>{ std::forward<T>(key), hash }, std::forward<E>(value));
+        });
+    }
+
+    /**
+     * Set a key-value pair in the map, which expires after a time
+     * @param key key to associate with value
+     * @param value value to associate with the key
+     * @param ttl time to live of the entry; zero means forever
+     */
+    template <class T, class E, class TRep, class TPeriod>
+    void put(T && key, E && value, std::chrono::duration<TRep, TPeriod> ttl) {
+        auto hash = hasher(key);
+        write(shardOf(hash), [&](map_type & map) {
+            map.put(HashedKey<T>{ std::forward<T>(key), hash }, std::forward<E>(value), ttl);
+        });
+    }
+
+    /**
+     * Atomically get the value associated with a key, or associate the given
+     *     value with it if there is none.  Either way the entry ends up at the
+     *     head of its shard LRU.
+     * @param key key to look up
+     * @param value value to put if the key is absent
+     * @return a copy of the value associated with the key after the call
+     */
+    template <class T, class E>
+    TValue getOrPut(T && key, E && value) {
+        const TKey & k = key;
+        auto hash = hasher(k);
+
+        return write(shardOf(hash), [&](map_type & map) {
+            auto it = map.find(HashedKey<const TKey &>{ k, hash });
+            if (it != map.end())
+                return TValue(it->second);
+
+            TValue result = std::forward<E>(value);
+            map.put(HashedKey<T>{ std::forward<T>(key), hash }, result);
+
+            return result;
+        });
+    }
+
+    /**
+     * Get a copy of the value associated with a key, or load it if there is
+     *     none.  Concurrent misses of a key run the loader once: the first
+     *     thread calls it out of the shard lock and puts the value, the
+     *     others wait and get the same value.  If the loader throws, every
+     *     waiting thread gets the exception and nothing is put, so the next
+     *     call loads again.  If the removal listener throws on the entries
+     *     the put evicted, the value stays cached and the waiting threads
+     *     get it; only the calling thread gets the exception.
+     * @param key key associated with the value
+     * @param loader function taking the key and returning its value; it may
+     *     use the map but must not wait for a load of the same key
+     * @return the value
+     */
+    template <class TLoader>
+    TValue getOrCompute(const TKey & key, TLoader && loader) {
+        auto hash = hasher(key);
+        if (auto cached = getKey(key, hash))
+            return std::move(*cached);
+
+        auto & shard = shardOf(hash);
+
+        std::optional<TValue> found;
+        std::shared_future<TValue> pending;
+        std::promise<TValue> promise;
+
+        //  the miss is already counted: look again without counting
+        write(shard, [&](map_type & map) {
+            auto it = std::as_const(map).find(HashedKey<const TKey &>{ key, hash });
+            if (it != map.cend()) {
+                found = it->second;
+                return;
+            }
+
+            auto flight = shard.loading.find(key);
+            if (flight != shard.loading.end()) {
+                pending = flight->second;
+                return;
+            }
+
+            shard.loading.emplace(key, promise.get_future().share());
+        });
+
+        if (found)
+            return std::move(*found);
+
+        if (pending.valid())
+            return pending.get();
+
+        std::optional<TValue> value;
+        std::vector<typename map_type::Removal> removed;
+        try {
+            value.emplace(loader(key));
+
+            update(shard, removed, [&](map_type & map) {
+                map.put(HashedKey<const TKey &>{ key, hash }, *value);
+                shard.loading.erase(key);
+            });
+        } catch (...) {
+            {
+                std::unique_lock<std::shared_mutex> lock(shard.mutex);
+                shard.loading.erase(key);
+            }
+
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+
+        //  the value is cached: a failing listener is not a failed load
+        promise.set_value(*value);
+        notify(removed);
+
+        return std::move(*value);
+    }
+
+    /**
+     * Associate a value built in place from args with a key, unless the key
+     *     already exists, in which case nothing is built (see
+     *     EvictingCacheMap::try_emplace())
+     * @param key key to associate with the value
+     * @param args arguments of the TValue constructor
+     * @return true if the value was built and kept
+     */
+    template <class T, class... Args>
+    bool try_emplace(T && key, Args &&... args) {
+        auto hash = hasher(key);
+        return write(shardOf(hash), [&](map_type & map) {
+            return map.try_emplace(HashedKey<T>{ std::forward<T>(key), hash },
+                                   std::forward<Args>(args)...).second;
+        });
+    }
+
+    /**
+     * Erase the key-value pair associated with key if it exists.
+     * @param key key associated with the value
+     * @return true if the key existed and was erased, else false
+     */
+    bool erase(const TKey & key) {
+        return eraseKey(key);
+    }
+
+    //  heterogeneous lookup, with a transparent THash as for EvictingCacheMap
+
+    template <class K, class H = THash, class = std::enable_if_t<IsTransparent<H>::value>>
+    bool exists(const K & key) const {
+        return containsKey(key);
+    }
+
+    template <class K, class H = THash, class = std::enable_if_t<IsTransparent<H>::value>>
+    std::optional<TValue> get(const K & key) {
+        return getKey(key);
+    }
+
+    template <class K, class H = THash, class = std::enable_if_t<IsTransparent<H>::value>>
+    bool erase(const K & key) {
+        return eraseKey(key);
+    }
+
+    template <class K, class TVisit, class H = THash, class = std::enable_if_t<IsTransparent<H>::value>>
+    bool visit(const K & key, TVisit && function) {
+        return visitKey(key, function);
+    }
+
+    /**
+     * Get the number of elements in the map.  Shards are counted one after
+     *     another, so the result may be stale under concurrent updates.
+     * @return the size of the map
+     */
+    std::size_t size() const {
+        std::size_t result = 0;
+        for (std::size_t i = 0; i < shardCount(); ++i) {
+            std::shared_lock<std::shared_mutex> lock(shards[i].mutex);
+            result += shards[i].map.size();
+        }
+
+        return result;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    void clear() {
+        for (std::size_t i = 0; i < shardCount(); ++i) {
+            write(shards[i], [](map_type & map) {
+                map.clear();
+            });
+        }
+    }
+
+    /**
+     * Set the function told about every entry leaving the map, or none.
+     *     Removals are delivered by the thread which caused them, after it
+     *     released the shard lock.  Not thread-safe: set it before sharing
+     *     the map.
+     * @param function listener taking the removed entry and the cause
+     */
+    void setRemovalListener(removal_listener function) {
+        listener = std::move(function);
+
+        for (std::size_t i = 0; i < shardCount(); ++i) {
+            shards[i].map.recordRemovals(static_cast<bool>(listener));
+        }
+    }
+
+    /**
+     * Take a snapshot of the statistics of all the shards.  Shards are read
+     *     one after another, so under concurrent updates the counters may
+     *     not add up exactly.
+     * @return the snapshot
+     */
+    CacheStats stats() const {
+        CacheStats result;
+        for (std::size_t i = 0; i < shardCount(); ++i) {
+            std::shared_lock<std::shared_mutex> lock(shards[i].mutex);
+            result += shards[i].map.stats();
+        }
+
+        if constexpr (TStats::ENABLED) {
+            for (auto & stripe : readStats) {
+                result.hits += stripe.hits.load(std::memory_order_relaxed);
+                result.misses += stripe.misses.load(std::memory_order_relaxed);
+            }
+        }
+
+        return result;
+    }
+
+    /**
+     * Zero the counters of stats()
+     */
+    void resetStats() {
+        for (std::size_t i = 0; i < shardCount(); ++i) {
+            std::unique_lock<std::shared_mutex> lock(shards[i].mutex);
+            shards[i].map.resetStats();
+        }
+
+        for (auto & stripe : readStats) {
+            stripe.hits.store(0, std::memory_order_relaxed);
+            stripe.misses.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    std::size_t shardCount() const noexcept {
+        return std::size_t(1) << shardBits;
+    }
+
+    std::size_t getShardCapacity() const noexcept {
+        return shardCapacity;
+    }
+
+private:
+    static constexpr const std::size_t READ_BUFFER_STRIPES = 4;
+    static constexpr const std::size_t READ_BUFFER_SIZE = 32;
+
+    using read_buffer_type = ReadBuffer<typename map_type::const_iterator, READ_BUFFER_SIZE>;
+
+    //  loads in flight, which the threads missing the same key wait for
+    using loading_map = std::unordered_map<TKey, std::shared_future<TValue>, THash>;
+
+    //  shards sit on their own cache lines, so that locking one does not slow
+    //  down threads working on its neighbours
+    struct alignas(64) Shard final {
+        mutable std::shared_mutex mutex;
+        map_type map = map_type(0);
+
+        read_buffer_type buffers[READ_BUFFER_STRIPES];
+
+        loading_map loading;
+    };
+
+    //  hits and misses of the reads under the shared lock, which must not
+    //  write to the counters of the shard maps
+    struct alignas(64) ReadStats final {
+        std::atomic<std::uint64_t> hits{ 0 };
+        std::atomic<std::uint64_t> misses{ 0 };
+    };
+
+    std::unique_ptr<Shard[]> shards;
+    ReadStats readStats[READ_BUFFER_STRIPES];
+    unsigned shardBits = 0;
+    std::size_t shardCapacity = 0;
+
+    THash hasher;
+    removal_listener listener;
+
+    /**
+     * Run a write on a shard under its exclusive lock, then deliver the
+     *     removals it caused once the lock is released
+     * @param shard shard to write
+     * @param operation function taking the shard map
+     * @return the result of the operation
+     */
+    template <class TWrite>
+    auto write(Shard & shard, TWrite && operation) {
+        std::vector<typename map_type::Removal> removed;
+
+        if constexpr (std::is_void<decltype(operation(shard.map))>::value) {
+            update(shard, removed, operation);
+            notify(removed);
+        } else {
+            auto result = update(shard, removed, operation);
+            notify(removed);
+            return result;
+        }
+    }
+
+    /**
+     * write() leaving the removals to the caller, to deliver once the lock
+     *     is released
+     * @param removed vector receiving the removals
+     */
+    template <class TWrite>
+    auto update(Shard & shard, std::vector<typename map_type::Removal> & removed, TWrite && operation) {
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        drain(shard);
+
+        if constexpr (std::is_void<decltype(operation(shard.map))>::value) {
+            operation(shard.map);
+            shard.map.takeRemovals(removed);
+        } else {
+            auto result = operation(shard.map);
+            shard.map.takeRemovals(removed);
+            return result;
+        }
+    }
+
+    void notify(std::vector<typename map_type::Removal> & removed) {
+        for (auto & removal : removed) {
+            listener(std::move(removal.entry), removal.cause);
+        }
+    }
+
+    template <class K>
+    bool containsKey(const K & key) const {
+        auto hash = hasher(key);
+        auto & shard = shardOf(hash);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+
+        return shard.map.exists(HashedKey<const K &>{ key, hash });
+    }
+
+    template <class K>
+    std::optional<TValue> getKey(const K & key) {
+        return getKey(key, hasher(key));
+    }
+
+    template <class K>
+    std::optional<TValue> getKey(const K & key, std::size_t hash) {
+        std::optional<TValue> result;
+        visitKey(key, hash, [&result](const TValue & value) {
+            result = value;
+        });
+
+        return result;
+    }
+
+    template <class K, class TVisit>
+    bool visitKey(const K & key, TVisit && function) {
+        return visitKey(key, hasher(key), function);
+    }
+
+    template <class K, class TVisit>
+    bool visitKey(const K & key, std::size_t hash, TVisit && function) {
+        auto & shard = shardOf(hash);
+        bool full = false;
+
+        {
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+
+            auto it = std::as_const(shard.map).find(HashedKey<const K &>{ key, hash });
+            if (it == shard.map.cend()) {
+                if constexpr (TStats::ENABLED)
+                    readStats[stripe()].misses.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+
+            if constexpr (TStats::ENABLED)
+                readStats[stripe()].hits.fetch_add(1, std::memory_order_relaxed);
+
+            function(it->second);
+            full = shard.buffers[stripe()].record(it);
+        }
+
+        if (full) {
+            std::unique_lock<std::shared_mutex> lock(shard.mutex, std::try_to_lock);
+            if (lock.owns_lock())
+                drain(shard);
+        }
+
+        return true;
+    }
+
+    template <class K>
+    bool eraseKey(const K & key) {
+        auto hash = hasher(key);
+        return write(shardOf(hash), [&key, hash](map_type & map) {
+            return map.erase(HashedKey<const K &>{ key, hash });
+        });
+    }
+
+    /**
+     * Apply the buffered reads of a shard, whose lock must be held exclusively
+     */
+    static void drain(Shard & shard) {
+        for (auto & buffer : shard.buffers) {
+            buffer.drain([&shard](typename map_type::const_iterator it) {
+                shard.map.promote(it);
+            });
+        }
+    }
+
+    /**
+     * Read buffer stripe of the calling thread
+     */
+    static std::size_t stripe() noexcept {
+        static thread_local const std::size_t value =
+                std::hash<std::thread::id>()(std::this_thread::get_id()) % READ_BUFFER_STRIPES;
+
+        return value;
+    }
+
+    /**
+     * Pick the shard of a key from the high bits of its scrambled hash; the
+     *     index of each shard map works on the low bits
+     * @param hash hash of the key, handed to the shard map as well
+     */
+    Shard & shardOf(std::size_t hash) const {
+        if (shardBits == 0)
+            return shards[0];
+
+        auto h = static_cast<std::uint64_t>(hash) * 0x9E3779B97F4A7C15ull;
+        return shards[static_cast<std::size_t>(h >> (64 - shardBits))];
+    }
+};
+
+#endif //LRU_CONCURRENTEVICTINGCACHEMAP_H
@@ -0,0 +1,115 @@
+#ifndef LRU_CONTROLGROUP_H
+#define LRU_CONTROLGROUP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LRU_CONTROL_GROUP_SSE2 1
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+/**
+ * Sixteen consecutive control bytes of SlotIndex, one per bucket, compared
+ *     all at once: with one SSE2 comparison where the target has it, byte by
+ *     byte otherwise.  A control byte is EMPTY, DELETED, or the 7-bit tag of
+ *     the hash of the key indexed in its bucket, so that only buckets whose
+ *     tag matches need a look at their key.  Matches come as a bit mask, bit
+ *     i standing for byte i.
+ */
+class ControlGroup final {
+public:
+    static constexpr const std::size_t SIZE = 16;
+
+    //  the high bit marks the codes which are not tags
+    static constexpr const std::uint8_t EMPTY = 0x80;
+    static constexpr const std::uint8_t DELETED = 0xFE;
+
+    /**
+     * Load a group
+     * @param controls first control byte of the group; 16 must be readable
+     */
+    explicit ControlGroup(const std::uint8_t * controls) noexcept {
+#ifdef LRU_CONTROL_GROUP_SSE2
+        bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(controls));
+#else
+        std::memcpy(bytes, controls, SIZE);
+#endif
+    }
+
+    /**
+     * Find the bytes equal to a tag or a code
+     * @param control the tag or code
+     * @return the mask of the matching bytes
+     */
+    std::uint32_t match(std::uint8_t control) const noexcept {
+#ifdef LRU_CONTROL_GROUP_SSE2
+        auto pattern = _mm_set1_epi8(static_cast<char>(control));
+        return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, pattern)));
+#else
+        std::uint32_t mask = 0;
+        for (std::size_t i = 0; i < SIZE; ++i) {
+            mask |= static_cast<std::uint32_t>(bytes[i] == control) << i;
+        }
+
+        return mask;
+#endif
+    }
+
+    std::uint32_t matchEmpty() const noexcept {
+        return match(EMPTY);
+    }
+
+    /**
+     * Find the buckets free for an insertion, empty or deleted
+     * @return the mask of their bytes
+     */
+    std::uint32_t matchFree() const noexcept {
+#ifdef LRU_CONTROL_GROUP_SSE2
+        return static_cast<std::uint32_t>(_mm_movemask_epi8(bytes));
+#else
+        std::uint32_t mask = 0;
+        for (std::size_t i = 0; i < SIZE; ++i) {
+            mask |= static_cast<std::uint32_t>(bytes[i] >> 7) << i;
+        }
+
+        return mask;
+#endif
+    }
+
+    /**
+     * Get the position of the lowest set bit of a mask
+     * @param mask a mask, not 0
+     */
+    static std::size_t lowestBit(std::uint32_t mask) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+        return static_cast<std::size_t>(__builtin_ctz(mask));
+#elif defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return index;
+#else
+        std::size_t index = 0;
+        while ((mask & 1) == 0) {
+            mask >>= 1;
+            ++index;
+        }
+
+        return index;
+#endif
+    }
+
+private:
+#ifdef LRU_CONTROL_GROUP_SSE2
+    __m128i bytes;
+#else
+    std::uint8_t bytes[SIZE];
+#endif
+};
+
+#endif //LRU_CONTROLGROUP_H
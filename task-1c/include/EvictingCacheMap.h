@@ -1,68 +1,580 @@
 #ifndef LRU_EVICTINGCACHEMAP_H
 #define LRU_EVICTINGCACHEMAP_H
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <functional>
-#include <utility>
+#include <iterator>
+#include <memory>
+#include <new>
 #include <optional>
 #include <vector>
-#include <list>
 #include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
 #include <utility>
 
-template <class TKey, class TValue, class THash = std::hash<TKey>>
+#include "CacheStats.h"
+#include "EvictionPolicy.h"
+#include "Prefetch.h"
+#include "Snapshot.h"
+#include "SlotIndex.h"
+#include "TimerWheel.h"
+
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define LRU_HAS_PMR 1
+#endif
+
+/**
+ * Tag asking EvictingCacheMap to allocate the slots and the index for its
+ *     whole capacity on construction
+ */
+struct PreallocateTag final {
+    explicit PreallocateTag() = default;
+};
+
+inline constexpr const PreallocateTag PREALLOCATE{};
+
+/**
+ * Tells whether a hash function is transparent, i.e. hashes other types
+ *     than the key consistently with it
+ */
+template <class THash, class = void>
+struct IsTransparent : std::false_type {
+};
+
+template <class THash>
+struct IsTransparent<THash, std::void_t<typename THash::is_transparent>> : std::true_type {
+};
+
+/**
+ * A key with its hash by the THash of an EvictingCacheMap, for a caller which
+ *     hashes the key anyway, e.g. to pick a shard: the map then uses that
+ *     hash instead of hashing the key again.  T is the type of the key as
+ *     passed, a reference for lookups, possibly an rvalue one for puts.
+ */
+template <class T>
+struct HashedKey final {
+    T && key;
+    std::size_t hash;
+};
+
+/**
+ * Tells whether EvictingCacheMap keeps the hash of each key in its entry, so
+ *     that growing the index, evicting and erasing never hash a key again,
+ *     and lookups compare hashes before calling operator== on keys.  By
+ *     default the hash is kept unless the key is an arithmetic, enum or
+ *     pointer type, whose hashing and comparison are cheaper than the 8
+ *     bytes per entry.  Specialize it to decide otherwise for a key type or
+ *     a hash function.
+ */
+template <class TKey, class THash>
+struct StoreHash : std::bool_constant<!std::is_arithmetic<TKey>::value
+        && !std::is_enum<TKey>::value && !std::is_pointer<TKey>::value> {
+};
+
+/**
+ * Transparent hash function for std::string keys, which can also be looked
+ *     up by std::string_view or const char * without a temporary std::string
+ */
+struct StringHash final {
+    using is_transparent = void;
+
+    std::size_t operator()(std::string_view key) const noexcept {
+        return std::hash<std::string_view>()(key);
+    }
+};
+
+/**
+ * Why an entry left an EvictingCacheMap
+ */
+enum class RemovalCause {
+    EVICTED,    //  to make room, or to fit in the max weight
+    REPLACED,   //  put() gave its key another value
+    ERASED,     //  by erase()
+    EXPIRED,    //  its time to live is over
+    CLEARED     //  by clear()
+};
+
+/**
+ * Default weigher of EvictingCacheMap: every entry weighs 1, so the weight
+ *     of the map is its size
+ */
+struct UnitWeigher final {
+    template <class TKey, class TValue>
+    constexpr std::size_t operator()(const TKey &, const TValue &) const noexcept {
+        return 1;
+    }
+};
+
+/**
+ * Entries live in one contiguous array of slots.  The eviction order is a
+ *     doubly linked list threaded through the slots by 32-bit indices, and
+ *     keys are found through an open-addressing SlotIndex, so a cache hit
+ *     costs one probe of the index plus one access to the slot, and neither
+ *     put() nor erase() allocate once the slot array has grown to the
+ *     capacity.  A put() of a new key into a full map assigns the key and
+ *     the value over those of the victim, in its slot, so that keys and
+ *     values such as strings reuse the buffers they own; this needs entries
+ *     which are not trivially destructible and keys which can be written
+ *     through the non-const key of a standard-layout pair, other entries
+ *     are destroyed and constructed anew.
+ *
+ * TPolicy decides how hits reorder the list and which entry to evict (see
+ *     EvictionPolicy.h); iteration walks the list from its head.  With the
+ *     default LruPolicy that is from the most to the least recently used
+ *     entry.
+ *
+ * Iterators stay valid until their entry is erased, as with std::list.
+ *     References to entries are invalidated when the slot array grows.
+ *
+ * Memory is bounded by the capacity: the slot array never grows past it, and
+ *     the index never grows past the bucket count a full cache needs at the
+ *     max load factor.
+ *
+ * Besides the capacity, which counts entries, the map can be bounded by the
+ *     total weight of its entries.  TWeigher gives the weight of an entry as
+ *     weigher(key, value), e.g. its size in bytes; it is called as entries
+ *     are put and the result is kept with the entry, so changing a value in
+ *     place through an iterator does not change its weight.  With the default
+ *     UnitWeigher nothing is stored and the weight is the size.
+ *
+ * Entries keep the hash of their key when StoreHash says so, by default for
+ *     keys other than numbers, enums and pointers: THash is then called once
+ *     per put() or lookup, never when the index grows, entries are evicted
+ *     or erased, and keys are compared only when their hashes are equal.
+ *
+ * Entries may be given a time to live, per put() or by default.  Expired
+ *     entries are misses for every lookup and are reclaimed by a TimerWheel
+ *     as the operations of the map advance it; until then they still count
+ *     in size() and show up when iterating (see removeExpired()).  TClock
+ *     provides the time through now(), and can be replaced in tests.  Maps
+ *     which never set a TTL neither read the clock nor allocate the wheel.
+ *
+ * A removal listener can be told about every entry leaving the map, with the
+ *     cause.  It receives the entry as an rvalue, so it may move the key and
+ *     the value out instead of letting them be destroyed.  Notifications are
+ *     queued while the map changes and delivered in a batch once the call
+ *     that removed the entries is done with the map, so the listener may use
+ *     the map.  The listener belongs to the map object: a copy starts
+ *     without one, and a copy assignment keeps that of the map assigned to.
+ *
+ * saveSnapshot() writes the entries to a file in eviction order, and
+ *     loadSnapshot() rebuilds the map from it in bulk, e.g. to restart warm
+ *     after a deploy (see Snapshot.h for the format and the serializers).
+ *
+ * TStats decides whether the map counts hits, misses, promotions, insertions,
+ *     evictions and expirations for stats(): the default NoStats compiles
+ *     the counting out, CountingStats keeps plain counters.
+ *
+ * The slot array, the index and the timer wheel come from TAllocator,
+ *     rebound, and entries are constructed through it, so a
+ *     std::pmr::polymorphic_allocator (see PmrEvictingCacheMap) gives the
+ *     keys and values that take an allocator the memory resource of the map
+ *     too.  The slot array is the pool of the entries: evicted slots are
+ *     reused for new entries, so a full map asks TAllocator for nothing,
+ *     and what the keys and values allocate themselves can be recycled by
+ *     a std::pmr::unsynchronized_pool_resource.  Policies keep their own
+ *     metadata (ghost lists, frequency sketches) with the default
+ *     allocator.  As with the standard containers, copies select their
+ *     allocator with select_on_container_copy_construction() and
+ *     assignments keep it unless it propagates; a move between maps whose
+ *     allocators differ moves the entries one by one.
+ */
+template <class TKey, class TValue, class THash = std::hash<TKey>,
+        class TPolicy = LruPolicy, class TWeigher = UnitWeigher,
+        class TClock = std::chrono::steady_clock, class TStats = NoStats,
+        class TAllocator = std::allocator<std::pair<const TKey, TValue>>>
 class EvictingCacheMap final {
 public:
     using value_type = std::pair<const TKey, TValue>;
+    using allocator_type = TAllocator;
+    using removal_listener = std::function<void(std::pair<TKey, TValue> &&, RemovalCause)>;
+
+    /**
+     * An entry which left the map, waiting to be notified
+     */
+    struct Removal final {
+        std::pair<TKey, TValue> entry;
+        RemovalCause cause;
+    };
+
+private:
+    using mutable_value_type = std::pair<TKey, TValue>;
+
+    static constexpr const std::uint32_t NIL = UINT32_MAX;
+    static constexpr const std::uint32_t FREE = UINT32_MAX - 1;
+    static constexpr const std::size_t MAX_SLOTS = UINT32_MAX - 2;
+
+    static constexpr const std::size_t MIN_SLOTS = 8;
+
+    //  keys of a multiGet() or multiPut() are hashed and prefetched this many
+    //  at a time: enough misses in flight to hide the latency, few enough to
+    //  keep their lines in L1 until they are used
+    static constexpr const std::size_t BATCH_SIZE = 16;
+
+    static_assert(NIL == SlotIndex::NONE, "slot index must report misses as NIL");
+    static_assert(NIL == EvictionPolicyBase::NIL, "policies must use NIL as the list end");
+
+    //  entries can be moved out of a slot through the non-const key when the
+    //  two pair types share their layout
+    static constexpr const bool MUTABLE_KEYS =
+            std::is_standard_layout<value_type>::value
+            && std::is_standard_layout<mutable_value_type>::value;
+
+    static constexpr const bool WEIGHTED = !std::is_same<TWeigher, UnitWeigher>::value;
+    static constexpr const bool HASHED = StoreHash<TKey, THash>::value;
+
+    /**
+     * Weight of an entry, stored only for weighted maps
+     */
+    template <bool STORED, class = void>
+    struct SlotWeight {
+        std::size_t weight = 0;
+    };
+
+    template <class TDummy>
+    struct SlotWeight<false, TDummy> {
+        static constexpr const std::size_t weight = 1;
+    };
+
+    /**
+     * Hash of the key of an entry, stored only if StoreHash says so
+     */
+    template <bool STORED, class = void>
+    struct SlotHash {
+        std::size_t hash = 0;
+    };
+
+    template <class TDummy>
+    struct SlotHash<false, TDummy> {
+    };
+
+    struct Slot final : SlotWeight<WEIGHTED>, SlotHash<HASHED> {
+        Slot() noexcept {
+        }
+
+        Slot(const Slot &) = delete;
+        Slot & operator=(const Slot &) = delete;
+
+        ~Slot() {
+        }
+
+        union {
+            value_type value;
+            mutable_value_type mutableValue;
+        };
+
+        std::uint32_t prev = FREE;  //  FREE marks a slot without value
+        std::uint32_t next = NIL;
+
+        std::uint8_t mark = 0;      //  owned by the policy
+    };
+
+    using AllocatorTraits = std::allocator_traits<TAllocator>;
+    using SlotAllocator = typename AllocatorTraits::template rebind_alloc<Slot>;
+    using SlotVector = std::vector<Slot, SlotAllocator>;
+
+    //  storage changes hands on move assignment without looking at the entries
+    static constexpr const bool MOVE_STEALS =
+            AllocatorTraits::propagate_on_container_move_assignment::value
+            || AllocatorTraits::is_always_equal::value;
+
+    /**
+     * The list of slots as seen by the eviction policy
+     */
+    class PolicyList final {
+    public:
+        std::uint32_t head() const noexcept {
+            return map.head;
+        }
+
+        std::uint32_t tail() const noexcept {
+            return map.tail;
+        }
+
+        std::uint32_t next(std::uint32_t slot) const noexcept {
+            return map.slots[slot].next;
+        }
+
+        std::uint32_t prev(std::uint32_t slot) const noexcept {
+            return map.slots[slot].prev;
+        }
+
+        void pushFront(std::uint32_t slot) noexcept {
+            map.linkFront(slot);
+        }
 
-    using iterator = typename std::list<value_type>::iterator;
-    using const_iterator = typename std::list<value_type>::const_iterator;
+        void insertBefore(std::uint32_t slot, std::uint32_t pos) noexcept {
+            map.linkBefore(slot, pos);
+        }
+
+        void moveToFront(std::uint32_t slot) noexcept {
+            if (slot == map.head)
+                return;
+
+            map.unlink(slot);
+            map.linkFront(slot);
+        }
+
+        void unlink(std::uint32_t slot) noexcept {
+            map.unlink(slot);
+        }
+
+        std::uint8_t & mark(std::uint32_t slot) noexcept {
+            return map.slots[slot].mark;
+        }
+
+        std::size_t hash(std::uint32_t slot) const {
+            return map.hashOf(slot);
+        }
+
+    private:
+        EvictingCacheMap & map;
+
+        explicit PolicyList(EvictingCacheMap & map) noexcept
+                : map(map) {
+        }
+
+        friend class EvictingCacheMap;
+    };
+
+    template <bool IS_CONST>
+    class Iterator final {
+        using map_pointer = std::conditional_t<IS_CONST,
+                const EvictingCacheMap *, EvictingCacheMap *>;
+
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = EvictingCacheMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<IS_CONST, const value_type *, value_type *>;
+        using reference = std::conditional_t<IS_CONST, const value_type &, value_type &>;
+
+        Iterator() noexcept = default;
+
+        template <bool OTHER_CONST, class = std::enable_if_t<IS_CONST && !OTHER_CONST>>
+        Iterator(const Iterator<OTHER_CONST> & other) noexcept
+                : map(other.map), slot(other.slot) {
+        }
+
+        reference operator*() const {
+            return map->slots[slot].value;
+        }
+
+        pointer operator->() const {
+            return &map->slots[slot].value;
+        }
+
+        Iterator & operator++() {
+            slot = map->slots[slot].next;
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            auto tmp = *this;
+            ++*this;
+            return tmp;
+        }
+
+        Iterator & operator--() {
+            slot = (slot == NIL) ? map->tail : map->slots[slot].prev;
+            return *this;
+        }
+
+        Iterator operator--(int) {
+            auto tmp = *this;
+            --*this;
+            return tmp;
+        }
+
+        friend bool operator==(const Iterator & a, const Iterator & b) noexcept {
+            return a.map == b.map && a.slot == b.slot;
+        }
+
+        friend bool operator!=(const Iterator & a, const Iterator & b) noexcept {
+            return !(a == b);
+        }
+
+    private:
+        map_pointer map = nullptr;
+        std::uint32_t slot = NIL;
+
+        Iterator(map_pointer map, std::uint32_t slot) noexcept
+                : map(map), slot(slot) {
+        }
+
+        friend class Iterator<!IS_CONST>;
+        friend class EvictingCacheMap;
+    };
+
+public:
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
 
     /**
      * Construct a EvictingCacheMap
      * @param capacity maximum size of the cache map.  Once the map size exceeds
      *    maxSize, the map will begin to evict.
+     * @param hash hash function for the keys
     */
-    explicit EvictingCacheMap(std::size_t capacity)
-            : hashTable(capacity), capacity(capacity) {
+    explicit EvictingCacheMap(std::size_t capacity, const THash & hash = THash(),
+                              const TAllocator & allocator = TAllocator())
+            : EvictingCacheMap(capacity, SIZE_MAX, hash, TWeigher(), TClock(), allocator) {
+    }
+
+    /**
+     * Construct a EvictingCacheMap with the storage of an allocator
+     * @param capacity maximum size of the cache map
+     * @param allocator allocator of the storage, e.g. a memory resource for
+     *     PmrEvictingCacheMap
+     */
+    EvictingCacheMap(std::size_t capacity, const TAllocator & allocator)
+            : EvictingCacheMap(capacity, THash(), allocator) {
+    }
+
+    /**
+     * Construct a EvictingCacheMap bounded by the weight of its entries
+     * @param capacity maximum size of the cache map
+     * @param maxWeight maximum total weight of the entries
+     * @param hash hash function for the keys
+     * @param weigher weight function for the entries
+     * @param clock source of the time for expiry
+     * @param allocator allocator of the storage
+     */
+    EvictingCacheMap(std::size_t capacity, std::size_t maxWeight,
+                     const THash & hash = THash(), const TWeigher & weigher = TWeigher(),
+                     const TClock & clock = TClock(), const TAllocator & allocator = TAllocator())
+            : slots(SlotAllocator(allocator)), index(allocator),
+              capacity(capacity), maxWeight(maxWeight), timers(allocator),
+              hasher(hash), weigher(weigher), clock(clock) {
+        if (capacity > MAX_SLOTS)
+            throw std::length_error("EvictingCacheMap capacity is too large");
+
+        index.setLimit(capacity);
+        policy.setCapacity(capacity);
+    }
+
+    /**
+     * Construct a EvictingCacheMap with storage for the whole capacity, so
+     *     that neither the slots nor the index are ever reallocated
+     * @param capacity maximum size of the cache map
+     * @param hash hash function for the keys
+     */
+    EvictingCacheMap(std::size_t capacity, PreallocateTag, const THash & hash = THash(),
+                     const TAllocator & allocator = TAllocator())
+            : EvictingCacheMap(capacity, hash, allocator) {
+        reserve(capacity);
     }
 
-    EvictingCacheMap(const EvictingCacheMap & other) {
+    EvictingCacheMap(const EvictingCacheMap & other)
+            : EvictingCacheMap(0, AllocatorTraits::select_on_container_copy_construction(other.get_allocator())) {
         *this = other;
     }
 
-    EvictingCacheMap(EvictingCacheMap && other) noexcept {
+    EvictingCacheMap(EvictingCacheMap && other) noexcept
+            : EvictingCacheMap(0, other.get_allocator()) {
         *this = std::move(other);
     }
 
-    ~EvictingCacheMap() = default;
+    ~EvictingCacheMap() {
+        destroyValues();
+    }
 
     EvictingCacheMap & operator=(const EvictingCacheMap & other) {
         if (this == &other)
             return *this;
 
-        capacity = other.capacity;
+        //  the copy is structural: entries keep their slot numbers, so the
+        //  links, the index, the timers and the policy state are copied as
+        //  they are, without hashing nor looking up any key
+        auto newSlots = copySlots(other);
 
-        clear();    //  hashTable.size() == capacity
+        clearSlots();
+        slots.swap(newSlots);
+        head = other.head;
+        tail = other.tail;
+        freeHead = other.freeHead;
+        used = other.used;
+        count = other.count;
+        weight = other.weight;
 
-        for (auto it = other.list.rbegin(); it != other.list.rend(); ++it) {
-            put(it->first, it->second);
+        try {
+            auto time = copySettings(other);
+            policy = other.policy;
+            index = other.index;
+            timers = other.timers;
+
+            dropExpired(time);
+        } catch (...) {
+            clearSlots();
+            throw;
         }
 
+        counters = other.counters;
+
         return *this;
     }
 
-    EvictingCacheMap & operator=(EvictingCacheMap && other) noexcept {
+    EvictingCacheMap & operator=(EvictingCacheMap && other) noexcept(MOVE_STEALS) {
         if (this == &other)
             return *this;
 
-        list = std::move(other.list);
-        hashTable = std::move(other.hashTable);
+        if constexpr (!MOVE_STEALS) {
+            if (get_allocator() != other.get_allocator()) {
+                moveEntries(other);
+                return *this;
+            }
+        }
+
+        destroyValues();
+
+        //  a plain move assignment of a vector whose allocator does not
+        //  propagate would need movable slots
+        if constexpr (AllocatorTraits::propagate_on_container_move_assignment::value)
+            slots = std::move(other.slots);
+        else
+            slots.swap(other.slots);
+        index = std::move(other.index);
+        hasher = std::move(other.hasher);
+        weigher = std::move(other.weigher);
+        clock = std::move(other.clock);
+        policy = std::move(other.policy);
+        counters = std::move(other.counters);
+        timers = std::move(other.timers);
+        listener = std::move(other.listener);
+        removals = std::move(other.removals);
+
+        head = std::exchange(other.head, NIL);
+        tail = std::exchange(other.tail, NIL);
+        freeHead = std::exchange(other.freeHead, NIL);
+        used = std::exchange(other.used, 0);
+        count = std::exchange(other.count, 0);
+        weight = std::exchange(other.weight, 0);
 
         capacity = other.capacity;
+        maxWeight = other.maxWeight;
+        defaultTtl = other.defaultTtl;
+        recording = std::exchange(other.recording, false);
+
+        other.slots.clear();
+        other.removals.clear();
+        other.index.reset();
+        other.policy.clear();
+        other.timers.reset();
 
         return *this;
     }
 
+    allocator_type get_allocator() const noexcept {
+        return allocator_type(slots.get_allocator());
+    }
+
     /**
      * Check for existence of a specific key in the map.  This operation has
      *     no effect on LRU order.
@@ -70,54 +582,53 @@ public:
      * @return true if exists, false otherwise
     */
     bool exists(const TKey & key) const {
-        if (capacity == 0)
-            return false;
-
-        auto & bucket = hashTable[keyToBucket(key)];
-        for (auto & it : bucket) {
-            if (it->first == key)
-                return true;
-        }
-
-        return false;
+        return containsKey(key);
     }
 
     /**
      * Get the value associated with a specific key.  This function always
-     *     promotes a found value to the head of the LRU.
+     *     promotes a found value (to the head of the LRU with LruPolicy).
      * @param key key associated with the value
      * @return the value if it exists
     */
     std::optional<TValue> get(const TKey & key) {
-        auto it = find(key);
-        if (it == end())
-            return {};
-
-        return it->second;
+        return getKey(key);
     }
 
     /**
      * Get the iterator associated with a specific key.  This function always
-     *     promotes a found value to the head of the LRU.
+     *     promotes a found value (to the head of the LRU with LruPolicy).
      * @param key key to associate with value
      * @return the iterator of the object (a std::pair of const TKey, TValue) or
      *     end() if it does not exist
     */
     iterator find(const TKey & key) {
-        if (capacity == 0)
-            return end();
-
-        auto & bucket = hashTable[keyToBucket(key)];
-        for (auto & it : bucket) {
-            if (it->first != key)
-                continue;
+        return findKey(key);
+    }
 
-            list.splice(list.begin(), list, it);
+    /**
+     * Get the iterator associated with a specific key without promoting it.
+     *     Since it does not modify the map, several threads may call it at
+     *     once, and record the hit to promote() it later.
+     * @param key key to search for
+     * @return the iterator of the object or end() if it does not exist
+     */
+    const_iterator find(const TKey & key) const {
+        return findKey(key);
+    }
 
-            return it;
-        }
+    /**
+     * Promote an entry as a find() of its key would.  An iterator whose entry
+     *     has been erased meanwhile is ignored; if its slot has been reused,
+     *     the new entry is promoted instead, which only perturbs the eviction
+     *     order.
+     * @param it iterator obtained from this map
+     */
+    void promote(const_iterator it) {
+        if (it.map != this || it.slot >= used || slots[it.slot].prev == FREE)
+            return;
 
-        return end();
+        hit(it.slot);
     }
 
     /**
@@ -126,121 +637,1707 @@ public:
      * @return true if the key existed and was erased, else false
     */
     bool erase(const TKey & key) {
-        if (capacity == 0)
-            return false;
+        return eraseKey(key);
+    }
 
-        auto & bucket = hashTable[keyToBucket(key)];
-        for (auto itB = bucket.begin(); itB != bucket.end(); ++itB) {
-            if ((*itB)->first != key)
-                continue;
+    //  heterogeneous lookup: with a transparent THash, one which defines
+    //  is_transparent, keys can be looked up by any type which THash hashes
+    //  as it hashes the equal TKey and which compares with TKey through ==,
+    //  e.g. by std::string_view for std::string keys (see StringHash),
+    //  without building a TKey
+
+    template <class K, class H = THash, class = std::enable_if_t<IsTransparent<H>::value>>
+    bool exists(const K & key) const {
+        return containsKey(key);
+    }
 
-            auto & it = *itB;
-            bucket.erase(itB);
-            list.erase(it);
+    template <class K, class H = THash, class = std::enable_if_t<IsTransparent<H>::value>>
+    std::optional<TValue> get(const K & key) {
+        return getKey(key);
+    }
 
-            return true;
-        }
+    template <class K, class H = THash, class = std::enable_if_t<IsTransparent<H>::value>>
+    iterator find(const K & key) {
+        return findKey(key);
+    }
 
-        return false;
+    template <class K, class H = THash, class = std::enable_if_t<IsTransparent<H>::value>>
+    const_iterator find(const K & key) const {
+        return findKey(key);
+    }
+
+    template <class K, class H = THash, class = std::enable_if_t<IsTransparent<H>::value>>
+    bool erase(const K & key) {
+        return eraseKey(key);
+    }
+
+    template <class K, class TVisit, class H = THash, class = std::enable_if_t<IsTransparent<H>::value>>
+    bool visit(const K & key, TVisit && function) {
+        return visitKey(key, function);
+    }
+
+    template <class K, class H = THash, class = std::enable_if_t<IsTransparent<H>::value>>
+    TValue * peek(const K & key) {
+        auto slot = peekSlot(key);
+        return (slot == NIL) ? nullptr : &slots[slot].value.second;
+    }
+
+    template <class K, class H = THash, class = std::enable_if_t<IsTransparent<H>::value>>
+    const TValue * peek(const K & key) const {
+        auto slot = peekSlot(key);
+        return (slot == NIL) ? nullptr : &slots[slot].value.second;
+    }
+
+    //  keys hashed by the caller (see HashedKey): the hash must be the one
+    //  THash gives, and other key types than TKey follow the rules of the
+    //  heterogeneous lookup
+
+    template <class K>
+    bool exists(HashedKey<K> key) const {
+        return peekSlot(key.key, key.hash) != NIL;
+    }
+
+    template <class K>
+    iterator find(HashedKey<K> key) {
+        return findKey(key.key, key.hash);
+    }
+
+    template <class K>
+    const_iterator find(HashedKey<K> key) const {
+        return const_iterator(this, peekSlot(key.key, key.hash));
+    }
+
+    template <class K>
+    bool erase(HashedKey<K> key) {
+        return eraseKey(key.key, key.hash);
     }
 
-    /**
-     * Set a key-value pair in the dictionary
-     * @param key key to associate with value
-     * @param value value to associate with the key
-     */
     template <class T, class E>
-    void put(T && key, E && value) {
-        if (capacity == 0)
-            return;
+    void put(HashedKey<T> key, E && value) {
+        const TKey & k = key.key;
+        putFor(k, key.hash, std::forward<T>(key.key), std::forward<E>(value), defaultTtl);
+        notify();
+    }
 
-        auto it = find(key);
-        if (it != list.end()) {
-            it->second = std::forward<E>(value);
-            return;
-        }
+    template <class T, class E, class TRep, class TPeriod>
+    void put(HashedKey<T> key, E && value, std::chrono::duration<TRep, TPeriod> ttl) {
+        const TKey & k = key.key;
+        putFor(k, key.hash, std::forward<T>(key.key), std::forward<E>(value), toNanoseconds(ttl));
+        notify();
+    }
 
-        auto & bucket = hashTable[keyToBucket(key)];
-        list.emplace_front(std::forward<T>(key), std::forward<E>(value));
-        bucket.emplace_front(list.begin());
+    template <class T, class... Args>
+    std::pair<iterator, bool> try_emplace(HashedKey<T> key, Args &&... args) {
+        if (capacity == 0)
+            return { end(), false };
 
-        if (list.size() > capacity)
-            erase(list.rbegin()->first);
+        const TKey & k = key.key;
+        auto result = tryEmplaceSlot(k, key.hash, std::forward<T>(key.key), std::forward<Args>(args)...);
+        notify();
 
-    if (bucket.size() > BUCKET_SIZE)
-        rehash();
+        return { iterator(this, result.first), result.second };
     }
 
     /**
-     * Get the number of elements in the dictionary
-     * @return the size of the dictionary
-    */
-    std::size_t size() const {
-        return list.size();
+     * Run a function on the value associated with a key, in place rather
+     *     than on a copy.  This function always promotes a found value, as
+     *     find() does.  The function must not use the map; changing the
+     *     value does not change its weight.
+     * @param key key associated with the value
+     * @param function function taking a TValue &
+     * @return true if the key was found and the function called
+     */
+    template <class TVisit>
+    bool visit(const TKey & key, TVisit && function) {
+        return visitKey(key, function);
     }
 
     /**
-     * Typical empty function
-     * @return true if empty, false otherwise
-    */
-    bool empty() const {
-        return list.empty();
+     * Get a pointer to the value associated with a key without promoting it.
+     *     The pointer is invalidated as references are, by erasing the entry
+     *     or by growing the slot array.
+     * @param key key associated with the value
+     * @return a pointer to the value, or nullptr if it does not exist
+     */
+    TValue * peek(const TKey & key) {
+        auto slot = peekSlot(key);
+        return (slot == NIL) ? nullptr : &slots[slot].value.second;
     }
 
-    void clear() {
-        hashTable = std::vector<std::list<iterator>>(capacity);
-        list.clear();
+    const TValue * peek(const TKey & key) const {
+        auto slot = peekSlot(key);
+        return (slot == NIL) ? nullptr : &slots[slot].value.second;
     }
 
-    // Iterators and such
-    iterator begin() noexcept {
-        return list.begin();
-    }
+    /**
+     * Associate a value built in place from args with a key, unless the key
+     *     already exists: then nothing is built nor replaced, and the entry
+     *     is promoted as find() would.  The entry gets the default TTL, and
+     *     eviction happens as for put().
+     * @param key key to associate with the value
+     * @param args arguments of the TValue constructor
+     * @return the iterator of the entry of the key, or end() if the new entry
+     *     was too heavy to keep, and whether the value was built
+     */
+    template <class T, class... Args>
+    std::pair<iterator, bool> try_emplace(T && key, Args &&... args) {
+        if (capacity == 0)
+            return { end(), false };
 
-    iterator end() noexcept {
-        return list.end();
+        const TKey & k = key;
+        auto result = tryEmplaceSlot(k, hasher(k), std::forward<T>(key), std::forward<Args>(args)...);
+        notify();
+
+        return { iterator(this, result.first), result.second };
     }
 
-    const_iterator begin() const noexcept {
-        return list.begin();
+    /**
+     * try_emplace() with the key built from a tuple of arguments as well, as
+     *     with std::piecewise_construct for std::pair.  The key is built
+     *     first, to be looked up; the value only if the key is missing.
+     * @param keyArgs arguments of the TKey constructor
+     * @param valueArgs arguments of the TValue constructor
+     * @return as for try_emplace()
+     */
+    template <class... KArgs, class... VArgs>
+    std::pair<iterator, bool> emplace(std::piecewise_construct_t,
+                                      std::tuple<KArgs...> keyArgs, std::tuple<VArgs...> valueArgs) {
+        auto key = std::make_from_tuple<TKey>(std::move(keyArgs));
+
+        return std::apply([this, &key](auto &&... args) {
+            return try_emplace(std::move(key), std::forward<decltype(args)>(args)...);
+        }, std::move(valueArgs));
     }
 
-    const_iterator end() const noexcept {
-        return list.end();
+    /**
+     * Set a key-value pair in the dictionary.  Entries are evicted until
+     *     both the size and the weight of the map are within bounds; when
+     *     the value of a key is replaced, the policy may pick that very
+     *     entry.  An entry heavier than the max weight is not kept at all.
+     * @param key key to associate with value
+     * @param value value to associate with the key
+     */
+    template <class T, class E>
+    void put(T && key, E && value) {
+        putFor(std::forward<T>(key), std::forward<E>(value), defaultTtl);
+        notify();
     }
 
-    const_iterator cbegin() const noexcept {
-        return list.cbegin();
+    /**
+     * Set a key-value pair in the dictionary, which expires after a time
+     * @param key key to associate with value
+     * @param value value to associate with the key
+     * @param ttl time to live of the entry; zero means forever
+     */
+    template <class T, class E, class TRep, class TPeriod>
+    void put(T && key, E && value, std::chrono::duration<TRep, TPeriod> ttl) {
+        putFor(std::forward<T>(key), std::forward<E>(value), toNanoseconds(ttl));
+        notify();
     }
 
-    const_iterator cend() const noexcept {
-        return list.cend();
+    /**
+     * Get the value associated with a key, or compute it and associate it
+     *     with the key if there is none.  A found value is promoted as by
+     *     get(), a computed one is put() with the default TTL.  If the loader
+     *     throws, the exception propagates and the map is left as the loader
+     *     left it.
+     * @param key key associated with the value
+     * @param loader function taking the key and returning its value; it may
+     *     use the map
+     * @return a copy of the value
+     */
+    template <class T, class TLoader>
+    TValue getOrCompute(T && key, TLoader && loader) {
+        const TKey & k = key;
+
+        auto it = find(k);
+        if (it != end())
+            return it->second;
+
+        TValue value = loader(k);
+        put(std::forward<T>(key), value);
+
+        return value;
     }
 
-private:
-    static constexpr const std::size_t BUCKET_SIZE = 1;
+    /**
+     * Get the values of a batch of keys, as calling get() on each key in turn
+     *     would: found values are promoted in the order of the keys, so the
+     *     last key found ends up most recently used with LruPolicy.  The
+     *     memory accesses of consecutive keys overlap: a group of keys is
+     *     hashed and its index buckets and slots prefetched before any of
+     *     them is looked up, which pays off when the map does not fit in the
+     *     processor caches.
+     * @param first first key; the range must allow several passes, e.g. an
+     *     array or a vector
+     * @param last end of the keys
+     * @param out output iterator receiving a std::optional<TValue> per key
+     * @return the number of keys found
+     */
+    template <class TKeyIterator, class TOutputIterator>
+    std::size_t multiGet(TKeyIterator first, TKeyIterator last, TOutputIterator out) {
+        std::size_t hashes[BATCH_SIZE];
+        std::size_t found = 0;
 
-    std::list<value_type> list;
-    std::vector<std::list<iterator>> hashTable;
+        while (first != last) {
+            auto batchFirst = first;
+            std::size_t n = 0;
+            for (; n < BATCH_SIZE && first != last; ++n, ++first) {
+                hashes[n] = hasher(*first);
+                index.prefetch(hashes[n]);
+            }
 
-    std::size_t capacity = 0;
+            prefetchSlots(hashes, n);
+
+            for (std::size_t i = 0; i < n; ++i, ++batchFirst) {
+                auto slot = findSlot(*batchFirst, hashes[i]);
+                if (slot == NIL) {
+                    *out = std::optional<TValue>();
+                } else {
+                    *out = std::optional<TValue>(slots[slot].value.second);
+                    ++found;
+                }
+                ++out;
+            }
+        }
+
+        notify();
 
-    std::size_t keyToBucket(const TKey & key) const noexcept {
-        return THash()(key) % hashTable.size();
+        return found;
     }
 
-    void rehash() {
-        auto oldTable = std::move(hashTable);
-        hashTable = std::vector<std::list<iterator>>(oldTable.size() * 2);
+    /**
+     * Set a batch of key-value pairs, as calling put() on each pair in turn
+     *     would, prefetching as multiGet() does
+     * @param first first pair (anything std::get<0> and std::get<1> take,
+     *     moved from through a std::move_iterator); the range must allow
+     *     several passes
+     * @param last end of the pairs
+     */
+    template <class TPairIterator>
+    void multiPut(TPairIterator first, TPairIterator last) {
+        std::size_t hashes[BATCH_SIZE];
+
+        while (first != last) {
+            auto batchFirst = first;
+            std::size_t n = 0;
+            for (; n < BATCH_SIZE && first != last; ++n, ++first) {
+                hashes[n] = hasher(static_cast<const TKey &>(std::get<0>(*first)));
+                index.prefetch(hashes[n]);
+            }
+
+            prefetchSlots(hashes, n);
 
-        for (auto & oldBucket : oldTable) {
-            while (!oldBucket.empty()) {
-                auto itB = oldBucket.begin();
-                auto & bucket = hashTable[keyToBucket((*itB)->first)];
-                bucket.splice(bucket.begin(), oldBucket, itB);
+            for (std::size_t i = 0; i < n; ++i, ++batchFirst) {
+                auto && kv = *batchFirst;
+                const TKey & k = std::get<0>(kv);
+                putFor(k, hashes[i], std::get<0>(std::forward<decltype(kv)>(kv)),
+                       std::get<1>(std::forward<decltype(kv)>(kv)), defaultTtl);
             }
         }
+
+        notify();
     }
-};
+
+    /**
+     * Put the entries of another map, from its least to its most recently
+     *     used, as put() would: keys already in this map get the value of the
+     *     other map.  The storage is reserved for both maps at once, and the
+     *     hashes stored in the other map are reused if THash has no state.
+     *     Entries keep their expiry times, or get the default TTL of this
+     *     map if they have none; expired ones are skipped.
+     * @param other map to take the entries of, left as it is
+     */
+    void merge(const EvictingCacheMap & other) {
+        mergeEntries(other, [](const value_type & kv) -> const TValue & {
+            return kv.second;
+        });
+    }
+
+    /**
+     * merge() moving the values, after which the other map is cleared
+     *     without notifications
+     */
+    void merge(EvictingCacheMap && other) {
+        mergeEntries(other, [](value_type & kv) -> TValue && {
+            return std::move(kv.second);
+        });
+        other.clearSlots();
+    }
+
+    /**
+     * Get the number of elements in the dictionary
+     * @return the size of the dictionary
+    */
+    std::size_t size() const {
+        return count;
+    }
+
+    /**
+     * Get the total weight of the entries, which is the size with the default
+     *     UnitWeigher
+     * @return the weight of the dictionary
+     */
+    std::size_t totalWeight() const noexcept {
+        return weight;
+    }
+
+    std::size_t getMaxWeight() const noexcept {
+        return maxWeight;
+    }
+
+    std::size_t getCapacity() const noexcept {
+        return capacity;
+    }
+
+    /**
+     * Change the capacity.  When it shrinks, the entries past it are evicted
+     *     in one batch, in eviction order, and notified once it is done; the
+     *     storage is kept, call shrink_to_fit() to release it.  When it
+     *     grows, the storage grows as entries are put.
+     * @param newCapacity maximum size of the cache map
+     */
+    void setCapacity(std::size_t newCapacity) {
+        if (newCapacity > MAX_SLOTS)
+            throw std::length_error("EvictingCacheMap capacity is too large");
+
+        capacity = newCapacity;
+        index.setLimit(capacity);
+        policy.setCapacity(capacity);
+
+        //  when most entries go, indexing the survivors again costs less
+        //  than erasing the others one by one
+        if (count > 2 * capacity) {
+            auto list = PolicyList(*this);
+            while (count > capacity)
+                release(policy.victim(list, 0), RemovalCause::EVICTED);
+
+            index.clear();
+            for (auto slot = head; slot != NIL; slot = slots[slot].next) {
+                index.insert(hashOf(slot), slot, slotHash());
+            }
+        }
+
+        while (count > capacity)
+            evict(0);
+        notify();
+    }
+
+    /**
+     * Change the weight bound, evicting entries until the map fits in it
+     * @param max maximum total weight of the entries
+     */
+    void setMaxWeight(std::size_t max) {
+        maxWeight = max;
+        evictToWeight(max, 0);
+        notify();
+    }
+
+    /**
+     * Typical empty function
+     * @return true if empty, false otherwise
+    */
+    bool empty() const {
+        return count == 0;
+    }
+
+    /**
+     * Erase all the entries.  The storage is kept for reuse; call
+     *     shrink_to_fit() to release it.
+     */
+    void clear() {
+        if (recording) {
+            for (auto slot = head; slot != NIL; slot = slots[slot].next) {
+                removals.push_back(Removal{ extract(slot), RemovalCause::CLEARED });
+            }
+        }
+
+        clearSlots();
+        notify();
+    }
+
+    /**
+     * Switch incremental rehashing of the key index on or off.  When on, the
+     *     index does not rehash all keys at once when it grows: the old and
+     *     the new buckets coexist and every put(), find() and erase() moves a
+     *     bounded number of buckets, so no single call pays for the whole
+     *     rehash.  Lookups check both bucket arrays until the move is over.
+     * @param enabled true to rehash incrementally, false (default) to rehash
+     *     at once
+     */
+    void setIncrementalRehash(bool enabled) {
+        index.setIncremental(enabled, slotHash());
+    }
+
+    bool isIncrementalRehash() const noexcept {
+        return index.isIncremental();
+    }
+
+    /**
+     * Set the time to live of the entries put without one
+     * @param ttl time to live; zero (the default) means forever
+     */
+    template <class TRep, class TPeriod>
+    void setDefaultTtl(std::chrono::duration<TRep, TPeriod> ttl) {
+        defaultTtl = toNanoseconds(ttl);
+    }
+
+    std::chrono::nanoseconds getDefaultTtl() const noexcept {
+        return std::chrono::nanoseconds(defaultTtl);
+    }
+
+    /**
+     * Reclaim every expired entry now, rather than as the timer wheel
+     *     advances, so that size() and iteration only see live entries
+     */
+    void removeExpired() {
+        if (!timers.started())
+            return;
+
+        expire();
+        timers.sweep([this](std::uint32_t slot) {
+            remove(slot, RemovalCause::EXPIRED);
+        });
+        notify();
+    }
+
+    /**
+     * Set the function told about every entry leaving the map, or none.  On
+     *     a REPLACED removal, the key stays in the map: the listener gets
+     *     the key passed to put(), moved from if it was an rvalue.
+     * @param function listener taking the removed entry and the cause
+     */
+    void setRemovalListener(removal_listener function) {
+        listener = std::move(function);
+        recording = static_cast<bool>(listener);
+    }
+
+    /**
+     * Queue removals without delivering them, for an owner which takes
+     *     them with takeRemovals() and notifies them itself, e.g. out of a
+     *     lock
+     * @param enabled true to queue removals
+     */
+    void recordRemovals(bool enabled) {
+        recording = enabled || listener;
+    }
+
+    /**
+     * Move the queued removals to a batch, which should be empty
+     * @param batch vector receiving the removals in the order they happened
+     */
+    void takeRemovals(std::vector<Removal> & batch) {
+        std::swap(removals, batch);
+    }
+
+    /**
+     * Take a snapshot of the statistics of the map.  The counters are only
+     *     kept with a counting TStats; the probe lengths are measured on the
+     *     spot by visiting the whole index.
+     * @return the snapshot
+     */
+    CacheStats stats() const {
+        CacheStats result;
+        counters.addTo(result);
+
+        result.rehashes = index.rehashCount();
+        result.rehashTime = index.rehashTime();
+        result.probes = index.probeCount(slotHash());
+        result.indexed = index.size();
+
+        return result;
+    }
+
+    /**
+     * Zero the counters of stats()
+     */
+    void resetStats() noexcept {
+        counters.clear();
+    }
+
+    /**
+     * Get the eviction policy, to inspect its state
+     * @return the policy
+     */
+    const TPolicy & getPolicy() const noexcept {
+        return policy;
+    }
+
+    /**
+     * Write the entries to a file, in list order from the tail: from the
+     *     least to the most recently used one with LruPolicy.  Expired entries
+     *     are left out and times to live are not saved.
+     * @param path path of the file, created or truncated
+     * @throw std::system_error if the file cannot be written
+     */
+    template <class TKeySerializer = Serializer<TKey>, class TValueSerializer = Serializer<TValue>>
+    void saveSnapshot(const std::string & path) const {
+        auto time = timers.started() ? now() : 0;
+        auto alive = [this, time](std::uint32_t slot) {
+            return !(timers.started() && timers.expired(slot, time));
+        };
+
+        SnapshotHeader header{};
+        std::memcpy(header.magic, SnapshotHeader::MAGIC, sizeof(header.magic));
+        header.version = SnapshotHeader::VERSION;
+        header.byteOrder = SnapshotHeader::BYTE_ORDER_MARK;
+        for (auto slot = head; slot != NIL; slot = slots[slot].next) {
+            header.count += alive(slot);
+        }
+
+        SnapshotWriter out(path);
+        out.write(&header, sizeof(header));
+
+        for (auto slot = tail; slot != NIL; slot = slots[slot].prev) {
+            if (alive(slot)) {
+                TKeySerializer::write(out, slots[slot].value.first);
+                TValueSerializer::write(out, slots[slot].value.second);
+            }
+        }
+
+        out.close();
+    }
+
+    /**
+     * Replace the entries with the ones of a snapshot, keeping their order.
+     *     The file is mapped in memory and parsed once into consecutive slots,
+     *     allocated up front; the index is then built in one bulk pass (see
+     *     SlotIndex::build()), so nothing goes through put() and nothing is
+     *     rehashed or reallocated on the way.  The oldest entries are dropped
+     *     if the snapshot holds more than the capacity or the max weight
+     *     allows.  Entries get the default time to live, if any, and
+     *     policies which keep more than an order (segments, frequencies)
+     *     start from the state of entries put in that order.
+     * @param path path of a file written by saveSnapshot() with the same
+     *     serializers
+     * @throw std::system_error if the file cannot be read, std::runtime_error
+     *     if it is not a valid snapshot; the map is then left empty
+     */
+    template <class TKeySerializer = Serializer<TKey>, class TValueSerializer = Serializer<TValue>>
+    void loadSnapshot(const std::string & path) {
+        MappedFile file(path);
+        SnapshotReader in(file.data(), file.size());
+
+        SnapshotHeader header;
+        in.read(&header, sizeof(header));
+        if (std::memcmp(header.magic, SnapshotHeader::MAGIC, sizeof(header.magic)) != 0
+                || header.version != SnapshotHeader::VERSION
+                || header.byteOrder != SnapshotHeader::BYTE_ORDER_MARK)
+            throw std::runtime_error(path + " is not a snapshot of this version and byte order");
+
+        clear();
+
+        auto skipped = (header.count > capacity) ? header.count - capacity : 0;
+        auto n = static_cast<std::size_t>(header.count - skipped);
+        if (n > slots.size())
+            resize(n);
+
+        auto expiry = TimerWheel::NEVER;
+        if (defaultTtl != 0) {
+            auto time = now();
+            if (!timers.started())
+                startTimers(time);
+            expiry = time + defaultTtl;
+        }
+
+        //  slots are taken in order from 0, so the hash of slot i is hashes[i]
+        std::vector<std::size_t> hashes;
+        hashes.reserve(n);
+
+        try {
+            auto list = PolicyList(*this);
+            for (std::uint64_t i = 0; i < header.count; ++i) {
+                TKey key = TKeySerializer::read(in);
+                TValue value = TValueSerializer::read(in);
+                if (i < skipped)
+                    continue;
+
+                std::size_t w = 1;
+                if constexpr (WEIGHTED) {
+                    w = weigher(key, value);
+                    if (w > maxWeight)
+                        continue;
+                }
+
+                auto hash = hasher(key);
+                auto slot = acquire();
+                construct(&slots[slot].value, std::move(key), std::move(value));
+
+                if constexpr (WEIGHTED)
+                    slots[slot].weight = w;
+                if constexpr (HASHED)
+                    slots[slot].hash = hash;
+
+                policy.onInsert(list, slot, hash);
+                counters.recordInsertion();
+                ++count;
+                weight += w;
+                hashes.push_back(hash);
+
+                if (timers.started())
+                    timers.schedule(slot, expiry);
+            }
+
+            if (!in.atEnd())
+                throw std::runtime_error(path + " has bytes past its entries");
+
+            auto hashOf = [&hashes](std::uint32_t slot) {
+                return hashes[slot];
+            };
+            auto same = [this](std::uint32_t a, std::uint32_t b) {
+                return slots[a].value.first == slots[b].value.first;
+            };
+            if (!index.build(used, hashOf, same))
+                throw std::runtime_error(path + " holds a key twice");
+        } catch (...) {
+            clearSlots();
+            throw;
+        }
+
+        if (count > 0)
+            evictToWeight(maxWeight, hashes.back());
+        notify();
+    }
+
+    /**
+     * Allocate storage for n entries (at most the capacity), so that putting
+     *     them neither grows the slot array nor rehashes the index
+     * @param n number of entries
+     */
+    void reserve(std::size_t n) {
+        n = std::min(n, capacity);
+
+        if (n > slots.size())
+            resize(n);
+
+        index.reserve(n, slotHash());
+    }
+
+    /**
+     * Release the storage not needed by the current entries.  The entries
+     *     are compacted to the front of the slot array in list order and the
+     *     index is rebuilt at its smallest size, so all iterators are
+     *     invalidated.
+     */
+    void shrink_to_fit() {
+        SlotVector newSlots(count, slots.get_allocator());
+        std::vector<std::uint32_t> newSlotOf(used, NIL);
+
+        std::uint32_t i = 0;
+        for (auto slot = head; slot != NIL; slot = slots[slot].next, ++i) {
+            relocate(newSlots[i], slots[slot]);
+
+            newSlots[i].prev = (i == 0) ? NIL : i - 1;
+            newSlots[i].next = (i + 1 == count) ? NIL : i + 1;
+            copyState(newSlots[i], slots[slot]);
+            newSlotOf[slot] = i;
+        }
+
+        slots.swap(newSlots);
+
+        auto renumber = [&newSlotOf](std::uint32_t slot) {
+            return newSlotOf[slot];
+        };
+        policy.renumber(renumber);
+
+        if (timers.started())
+            timers.renumber(count, renumber);
+
+        head = (count == 0) ? NIL : 0;
+        tail = (count == 0) ? NIL : static_cast<std::uint32_t>(count - 1);
+        freeHead = NIL;
+        used = static_cast<std::uint32_t>(count);
+
+        index.assign(used, slotHash());
+    }
+
+    /**
+     * Set the largest ratio of used to allocated index buckets.  Lower
+     *     values make probing shorter at the cost of memory.
+     * @param factor ratio in (0, 1), 0.5 by default
+     */
+    void max_load_factor(float factor) {
+        index.setMaxLoadFactor(factor, slotHash());
+    }
+
+    float max_load_factor() const noexcept {
+        return index.getMaxLoadFactor();
+    }
+
+    float load_factor() const noexcept {
+        return (index.bucketCount() == 0)
+                ? 0.0f
+                : static_cast<float>(count) / index.bucketCount();
+    }
+
+    std::size_t bucket_count() const noexcept {
+        return index.bucketCount();
+    }
+
+    // Iterators and such
+    iterator begin() noexcept {
+        return iterator(this, head);
+    }
+
+    iterator end() noexcept {
+        return iterator(this, NIL);
+    }
+
+    const_iterator begin() const noexcept {
+        return const_iterator(this, head);
+    }
+
+    const_iterator end() const noexcept {
+        return const_iterator(this, NIL);
+    }
+
+    const_iterator cbegin() const noexcept {
+        return begin();
+    }
+
+    const_iterator cend() const noexcept {
+        return end();
+    }
+
+    std::reverse_iterator<iterator> rbegin() noexcept {
+        return std::reverse_iterator<iterator>(end());
+    }
+
+    std::reverse_iterator<iterator> rend() noexcept {
+        return std::reverse_iterator<iterator>(begin());
+    }
+
+    std::reverse_iterator<const_iterator> rbegin() const noexcept {
+        return std::reverse_iterator<const_iterator>(end());
+    }
+
+    std::reverse_iterator<const_iterator> rend() const noexcept {
+        return std::reverse_iterator<const_iterator>(begin());
+    }
+
+private:
+    SlotVector slots;
+    BasicSlotIndex<TAllocator> index;
+
+    std::uint32_t head = NIL;       //  most recently used
+    std::uint32_t tail = NIL;       //  least recently used
+    std::uint32_t freeHead = NIL;   //  released slots, linked through next
+    std::uint32_t used = 0;         //  slots [used, slots.size()) were never used
+
+    std::size_t count = 0;
+    std::size_t capacity = 0;
+
+    std::size_t weight = 0;
+    std::size_t maxWeight = SIZE_MAX;
+
+    BasicTimerWheel<TAllocator> timers;
+    std::uint64_t defaultTtl = 0;
+
+    removal_listener listener;
+    std::vector<Removal> removals;  //  queued while recording
+    std::vector<Removal> batch;     //  being delivered
+    bool recording = false;
+    bool notifying = false;
+
+    TStats counters;                //  empty with NoStats: fits in the padding
+
+    THash hasher;
+    TWeigher weigher;
+    TClock clock;
+    TPolicy policy;
+
+    auto slotHash() const noexcept {
+        return [this](std::uint32_t slot) {
+            return hashOf(slot);
+        };
+    }
+
+    /**
+     * Get the hash of the key of an occupied slot, stored or computed
+     */
+    std::size_t hashOf(std::uint32_t slot) const {
+        if constexpr (HASHED)
+            return slots[slot].hash;
+        else
+            return hasher(slots[slot].value.first);
+    }
+
+    template <class K>
+    std::uint32_t lookup(const K & key, std::size_t hash) const {
+        return index.find(hash, [this, &key, hash](std::uint32_t slot) {
+            if constexpr (HASHED) {
+                if (slots[slot].hash != hash)
+                    return false;
+            }
+
+            return slots[slot].value.first == key;
+        });
+    }
+
+    /**
+     * Start loading the slots the keys of a batch most likely live in, then
+     *     their neighbours in the list, which promoting them relinks.  Their
+     *     home buckets should have been prefetched already.
+     */
+    void prefetchSlots(const std::size_t * hashes, std::size_t n) const noexcept {
+        std::uint32_t homes[BATCH_SIZE];
+        for (std::size_t i = 0; i < n; ++i) {
+            homes[i] = index.home(hashes[i]);
+            if (homes[i] < used)
+                prefetchRead(&slots[homes[i]]);
+        }
+
+        for (std::size_t i = 0; i < n; ++i) {
+            if (homes[i] >= used)
+                continue;
+
+            auto & s = slots[homes[i]];
+            if (s.prev < used)
+                prefetchRead(&slots[s.prev]);
+            if (s.next < used)
+                prefetchRead(&slots[s.next]);
+        }
+    }
+
+    /**
+     * put() with a time to live in nanoseconds, zero for none
+     */
+    template <class T, class E>
+    void putFor(T && key, E && value, std::uint64_t ttl) {
+        const TKey & k = key;
+        putFor(k, hasher(k), std::forward<T>(key), std::forward<E>(value), ttl);
+    }
+
+    /**
+     * putFor() of a key whose hash is known
+     * @param k the key, as the TKey which key converts to
+     * @param hash hash of the key
+     * @return the slot of the key, or NIL if the entry was not kept
+     */
+    template <class T, class E>
+    std::uint32_t putFor(const TKey & k, std::size_t hash, T && key, E && value, std::uint64_t ttl) {
+        if (capacity == 0)
+            return NIL;
+
+        std::uint64_t expiry;
+        auto slot = prepareWrite(k, hash, ttl, expiry);
+
+        if (slot != NIL) {
+            index.step(slotHash());
+            hit(slot);
+
+            //  the key stays: the equal key given to put() goes with the old
+            //  value, which works for move-only keys too
+            if (recording) {
+                auto & kv = slots[slot].value;
+                removals.push_back(Removal{ mutable_value_type(std::forward<T>(key), std::move(kv.second)),
+                                            RemovalCause::REPLACED });
+            }
+
+            slots[slot].value.second = std::forward<E>(value);
+
+            if (timers.started())
+                timers.schedule(slot, expiry);
+
+            if constexpr (WEIGHTED) {
+                auto & s = slots[slot];
+                weight -= s.weight;
+                s.weight = weigher(s.value.first, s.value.second);
+                weight += s.weight;
+
+                if (s.weight > maxWeight) {
+                    index.erase(hash, slot, slotHash());
+                    release(slot, RemovalCause::EVICTED);
+                    return NIL;
+                }
+
+                evictToWeight(maxWeight, hash);
+                if (slots[slot].prev == FREE)
+                    return NIL;
+            }
+            return slot;
+        }
+
+        std::size_t w = 1;
+        if constexpr (WEIGHTED) {
+            w = weigher(k, value);
+            if (w > maxWeight)
+                return NIL;
+        }
+
+        //  entries which own nothing gain nothing from being assigned
+        if constexpr (MUTABLE_KEYS && !std::is_trivially_destructible<value_type>::value
+                      && std::is_assignable<TKey &, T &&>::value
+                      && std::is_assignable<TValue &, E &&>::value) {
+            if (count == capacity) {
+                return reuse(hash, expiry, w, [&](mutable_value_type & entry) {
+                    entry.first = std::forward<T>(key);
+                    entry.second = std::forward<E>(value);
+                });
+            }
+        }
+
+        return insert(hash, expiry, w, [&](value_type * entry) {
+            construct(entry, std::forward<T>(key), std::forward<E>(value));
+        });
+    }
+
+    /**
+     * try_emplace() without notifying removals
+     * @param k the key, as the TKey which key converts to
+     * @param hash hash of the key
+     * @return the slot of the key, or NIL if the new entry was too heavy
+     */
+    template <class T, class... Args>
+    std::pair<std::uint32_t, bool> tryEmplaceSlot(const TKey & k, std::size_t hash, T && key, Args &&... args) {
+        std::uint64_t expiry;
+        auto slot = prepareWrite(k, hash, defaultTtl, expiry);
+
+        if (slot != NIL) {
+            index.step(slotHash());
+            hit(slot);
+            return { slot, false };
+        }
+
+        auto build = [&](value_type * entry) {
+            construct(entry, std::piecewise_construct,
+                      std::forward_as_tuple(std::forward<T>(key)),
+                      std::forward_as_tuple(std::forward<Args>(args)...));
+        };
+
+        if constexpr (!WEIGHTED) {
+            return { insert(hash, expiry, 1, build), true };
+        } else {
+            //  the value does not exist to be weighed before it is built: it
+            //  is built in a slot of its own, past the capacity if the map is
+            //  full, and room is made only once it is known to fit
+            slot = acquire();
+            try {
+                build(&slots[slot].value);
+            } catch (...) {
+                pushFree(slot);
+                throw;
+            }
+
+            auto w = weigher(slots[slot].value.first, slots[slot].value.second);
+            if (w > maxWeight) {
+                slots[slot].value.~value_type();
+                pushFree(slot);
+                return { NIL, false };
+            }
+
+            while (count == capacity || w > maxWeight - weight)
+                evict(hash);
+
+            link(slot, hash, expiry, w);
+            return { slot, true };
+        }
+    }
+
+    /**
+     * Start a write of a key: reclaim the expired entries, compute the expiry
+     *     of the entry and find the key, removing it if it has expired
+     * @param expiry set to the expiry time of the entry, or NEVER
+     * @return the slot of the live key or NIL
+     */
+    std::uint32_t prepareWrite(const TKey & key, std::size_t hash, std::uint64_t ttl,
+                               std::uint64_t & expiry) {
+        if (ttl != 0 && !timers.started())
+            startTimers(now());
+
+        auto time = expire();
+        expiry = (ttl == 0) ? TimerWheel::NEVER : time + ttl;
+
+        auto slot = lookup(key, hash);
+        if (slot != NIL && timers.started() && timers.expired(slot, time)) {
+            remove(slot, RemovalCause::EXPIRED);
+            return NIL;
+        }
+
+        return slot;
+    }
+
+    /**
+     * Add a new entry, evicting until there is room for its weight
+     * @param hash hash of the key
+     * @param expiry expiry time of the entry, or NEVER
+     * @param w weight of the entry
+     * @param construct function building the entry at the address it takes
+     * @return the slot of the entry
+     */
+    template <class TConstruct>
+    std::uint32_t insert(std::size_t hash, std::uint64_t expiry, std::size_t w,
+                         TConstruct && construct) {
+        while (count == capacity || w > maxWeight - weight)
+            evict(hash);
+
+        auto slot = acquire();
+        try {
+            construct(&slots[slot].value);
+        } catch (...) {
+            pushFree(slot);
+            throw;
+        }
+
+        link(slot, hash, expiry, w);
+        return slot;
+    }
+
+    /**
+     * insert() of a full map into the slot of its victim: the new key and
+     *     value are assigned over the old ones, which keeps the buffers they
+     *     own, e.g. those of strings, instead of freeing them for the new
+     *     entry to allocate its own
+     * @param assign function assigning the entry it takes
+     * @return the slot of the entry
+     */
+    template <class TAssign>
+    std::uint32_t reuse(std::size_t hash, std::uint64_t expiry, std::size_t w,
+                        TAssign && assign) {
+        auto list = PolicyList(*this);
+        auto slot = policy.victim(list, hash);
+        index.erase(hashOf(slot), slot, slotHash());
+        detach(slot, RemovalCause::EVICTED);
+
+        try {
+            while (w > maxWeight - weight)
+                evict(hash);
+
+            assign(slots[slot].mutableValue);
+        } catch (...) {
+            slots[slot].value.~value_type();
+            pushFree(slot);
+            throw;
+        }
+
+        link(slot, hash, expiry, w);
+        return slot;
+    }
+
+    /**
+     * Make a slot holding a new entry live: in the policy list, the timers
+     *     and the index
+     */
+    void link(std::uint32_t slot, std::size_t hash, std::uint64_t expiry, std::size_t w) {
+        if constexpr (WEIGHTED)
+            slots[slot].weight = w;
+        if constexpr (HASHED)
+            slots[slot].hash = hash;
+
+        auto list = PolicyList(*this);
+        policy.onInsert(list, slot, hash);
+        counters.recordInsertion();
+        ++count;
+        weight += w;
+
+        if (timers.started())
+            timers.schedule(slot, expiry);
+
+        index.insert(hash, slot, slotHash());
+    }
+
+    template <class K>
+    bool containsKey(const K & key) const {
+        return peekSlot(key) != NIL;
+    }
+
+    template <class K>
+    std::optional<TValue> getKey(const K & key) {
+        auto it = findKey(key);
+        if (it == end())
+            return {};
+
+        return it->second;
+    }
+
+    template <class K>
+    iterator findKey(const K & key) {
+        if (capacity == 0)
+            return end();
+
+        return findKey(key, hasher(key));
+    }
+
+    template <class K>
+    iterator findKey(const K & key, std::size_t hash) {
+        if (capacity == 0)
+            return end();
+
+        auto slot = findSlot(key, hash);
+        notify();
+
+        return iterator(this, slot);
+    }
+
+    template <class K>
+    const_iterator findKey(const K & key) const {
+        return const_iterator(this, peekSlot(key));
+    }
+
+    template <class K, class TVisit>
+    bool visitKey(const K & key, TVisit & function) {
+        if (capacity == 0)
+            return false;
+
+        auto slot = findSlot(key);
+        if (slot == NIL) {
+            notify();
+            return false;
+        }
+
+        function(slots[slot].value.second);
+        notify();
+
+        return true;
+    }
+
+    /**
+     * Find a live key without promoting it
+     * @return the slot of the key or NIL
+     */
+    template <class K>
+    std::uint32_t peekSlot(const K & key) const {
+        if (capacity == 0)
+            return NIL;
+
+        return peekSlot(key, hasher(key));
+    }
+
+    template <class K>
+    std::uint32_t peekSlot(const K & key, std::size_t hash) const {
+        if (capacity == 0)
+            return NIL;
+
+        auto slot = lookup(key, hash);
+        return live(slot) ? slot : NIL;
+    }
+
+    template <class K>
+    bool eraseKey(const K & key) {
+        if (capacity == 0)
+            return false;
+
+        return eraseKey(key, hasher(key));
+    }
+
+    template <class K>
+    bool eraseKey(const K & key, std::size_t hash) {
+        if (capacity == 0)
+            return false;
+
+        auto time = expire();
+        auto slot = lookup(key, hash);
+        if (slot == NIL)
+            return false;
+
+        bool expired = timers.started() && timers.expired(slot, time);
+
+        index.erase(hash, slot, slotHash());
+        release(slot, expired ? RemovalCause::EXPIRED : RemovalCause::ERASED);
+        notify();
+
+        return !expired;
+    }
+
+    /**
+     * find() without notifying removals
+     * @return the slot of the key or NIL
+     */
+    template <class K>
+    std::uint32_t findSlot(const K & key) {
+        return findSlot(key, hasher(key));
+    }
+
+    template <class K>
+    std::uint32_t findSlot(const K & key, std::size_t hash) {
+        index.step(slotHash());
+
+        auto time = expire();
+        auto slot = lookup(key, hash);
+        if (slot == NIL) {
+            counters.recordMiss();
+            return NIL;
+        }
+
+        if (timers.started() && timers.expired(slot, time)) {
+            remove(slot, RemovalCause::EXPIRED);
+            counters.recordMiss();
+            return NIL;
+        }
+
+        counters.recordHit();
+        hit(slot);
+
+        return slot;
+    }
+
+    void linkFront(std::uint32_t slot) noexcept {
+        slots[slot].prev = NIL;
+        slots[slot].next = head;
+
+        if (head != NIL)
+            slots[head].prev = slot;
+        else
+            tail = slot;
+
+        head = slot;
+    }
+
+    void unlink(std::uint32_t slot) noexcept {
+        auto & s = slots[slot];
+
+        if (s.prev != NIL)
+            slots[s.prev].next = s.next;
+        else
+            head = s.next;
+
+        if (s.next != NIL)
+            slots[s.next].prev = s.prev;
+        else
+            tail = s.prev;
+    }
+
+    /**
+     * Link a slot in front of pos, or at the tail if pos is NIL
+     */
+    void linkBefore(std::uint32_t slot, std::uint32_t pos) noexcept {
+        auto prev = (pos == NIL) ? tail : slots[pos].prev;
+
+        slots[slot].prev = prev;
+        slots[slot].next = pos;
+
+        if (prev != NIL)
+            slots[prev].next = slot;
+        else
+            head = slot;
+
+        if (pos != NIL)
+            slots[pos].prev = slot;
+        else
+            tail = slot;
+    }
+
+    void hit(std::uint32_t slot) {
+        counters.recordPromotion();
+
+        auto list = PolicyList(*this);
+        policy.onHit(list, slot);
+    }
+
+    /**
+     * Evict the entry chosen by the policy to make room for a key
+     * @param hash hash of the incoming key
+     */
+    void evict(std::size_t hash) {
+        auto list = PolicyList(*this);
+        remove(policy.victim(list, hash), RemovalCause::EVICTED);
+    }
+
+    /**
+     * Remove an entry from the index and release its slot
+     */
+    void remove(std::uint32_t slot, RemovalCause cause) {
+        index.erase(hashOf(slot), slot, slotHash());
+        release(slot, cause);
+    }
+
+    std::uint64_t now() const {
+        auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                clock.now().time_since_epoch());
+        return static_cast<std::uint64_t>(time.count());
+    }
+
+    /**
+     * Allocate the timer wheel, on the first use of a TTL
+     */
+    void startTimers(std::uint64_t time) {
+        timers.start(slots.size(), time);
+    }
+
+    /**
+     * Reclaim the entries whose timers are due, if any TTL was ever used
+     * @return the current time, or 0 without timers
+     */
+    std::uint64_t expire() {
+        if (!timers.started())
+            return 0;
+
+        auto time = now();
+        timers.advance(time, [this](std::uint32_t slot) {
+            remove(slot, RemovalCause::EXPIRED);
+        });
+
+        return time;
+    }
+
+    /**
+     * Tell whether a slot found by lookup() holds an entry which has not
+     *     expired
+     */
+    bool live(std::uint32_t slot) const {
+        return slot != NIL && !(timers.started() && timers.expired(slot, now()));
+    }
+
+    /**
+     * Convert a time to live to nanoseconds, saturating at about 292 years
+     */
+    template <class TRep, class TPeriod>
+    static std::uint64_t toNanoseconds(std::chrono::duration<TRep, TPeriod> ttl) {
+        using nanoseconds = std::chrono::nanoseconds;
+
+        if (ttl < ttl.zero())
+            throw std::invalid_argument("time to live must not be negative");
+
+        if (std::chrono::duration<double, std::nano>(ttl).count() >= nanoseconds::max().count())
+            return static_cast<std::uint64_t>(nanoseconds::max().count());
+
+        auto result = static_cast<std::uint64_t>(std::chrono::duration_cast<nanoseconds>(ttl).count());
+        return (result == 0 && ttl != ttl.zero()) ? 1 : result;
+    }
+
+    /**
+     * Evict entries until the total weight is at most max
+     * @param hash hash of the key being put, if any
+     */
+    void evictToWeight(std::size_t max, std::size_t hash) {
+        while (weight > max)
+            evict(hash);
+    }
+
+    /**
+     * Unlink an indexed-out slot from the policy list, queue or destroy its
+     *     value and return it to the free list
+     */
+    void release(std::uint32_t slot, RemovalCause cause) {
+        detach(slot, cause);
+
+        slots[slot].value.~value_type();
+        pushFree(slot);
+    }
+
+    /**
+     * release() but for the value, left in the slot for its next entry
+     */
+    void detach(std::uint32_t slot, RemovalCause cause) {
+        if (cause == RemovalCause::EVICTED)
+            counters.recordEviction();
+        else if (cause == RemovalCause::EXPIRED)
+            counters.recordExpiration();
+
+        if (recording)
+            removals.push_back(Removal{ extract(slot), cause });
+
+        auto list = PolicyList(*this);
+        policy.onRemove(list, slot);
+        weight -= slots[slot].weight;
+
+        if (timers.started())
+            timers.cancel(slot);
+
+        --count;
+    }
+
+    /**
+     * Move the entry of a slot out, leaving a moved-from value to destroy
+     */
+    mutable_value_type extract(std::uint32_t slot) {
+        if constexpr (MUTABLE_KEYS) {
+            return std::move(slots[slot].mutableValue);
+        } else {
+            return mutable_value_type(std::move(slots[slot].value));
+        }
+    }
+
+    /**
+     * Deliver the queued removals to the listener.  Removals queued by the
+     *     listener through the map are delivered by the same loop.
+     */
+    void notify() {
+        if (notifying || removals.empty() || !listener)
+            return;
+
+        notifying = true;
+        try {
+            while (!removals.empty()) {
+                std::swap(removals, batch);
+                for (auto & removal : batch) {
+                    listener(std::move(removal.entry), removal.cause);
+                }
+                batch.clear();
+            }
+        } catch (...) {
+            batch.clear();
+            notifying = false;
+            throw;
+        }
+
+        notifying = false;
+    }
+
+    void pushFree(std::uint32_t slot) noexcept {
+        slots[slot].prev = FREE;
+        slots[slot].next = freeHead;
+        freeHead = slot;
+    }
+
+    std::uint32_t acquire() {
+        if (freeHead != NIL) {
+            auto slot = freeHead;
+            freeHead = slots[slot].next;
+            return slot;
+        }
+
+        if (used == slots.size())
+            grow();
+
+        return used++;
+    }
+
+    /**
+     * Enlarge the slot array geometrically, never past the capacity but for
+     *     the one slot a weighted try_emplace() builds in on a full map.
+     *     Slot numbers are kept, so neither the LRU links nor the index
+     *     change.
+     */
+    void grow() {
+        auto limit = (count == capacity) ? capacity + 1 : capacity;
+        resize(std::min(limit, std::max(MIN_SLOTS, slots.size() * 2)));
+    }
+
+    void resize(std::size_t newSize) {
+        SlotVector newSlots(newSize, slots.get_allocator());
+        for (std::uint32_t i = 0; i < used; ++i) {
+            auto & from = slots[i];
+            auto & to = newSlots[i];
+
+            if (from.prev != FREE)
+                relocate(to, from);
+
+            to.prev = from.prev;
+            to.next = from.next;
+            copyState(to, from);
+        }
+
+        slots.swap(newSlots);
+
+        if (timers.started())
+            timers.resize(newSize);
+    }
+
+    /**
+     * Copy what the map and the policy keep about an entry, besides its
+     *     value and links
+     */
+    static void copyState(Slot & to, const Slot & from) noexcept {
+        to.mark = from.mark;
+
+        if constexpr (WEIGHTED)
+            to.weight = from.weight;
+        if constexpr (HASHED)
+            to.hash = from.hash;
+    }
+
+    /**
+     * Construct an entry through the allocator, which hands itself to the key
+     *     and the value if they take one (uses-allocator construction)
+     */
+    template <class... Args>
+    void construct(value_type * entry, Args &&... args) {
+        auto allocator = slots.get_allocator();
+        std::allocator_traits<SlotAllocator>::construct(allocator, entry, std::forward<Args>(args)...);
+    }
+
+    /**
+     * Move the value of an occupied slot into a slot without value, leaving
+     *     the links alone
+     */
+    static void relocate(Slot & to, Slot & from) {
+        if constexpr (MUTABLE_KEYS) {
+            new (&to.mutableValue) mutable_value_type(std::move(from.mutableValue));
+        } else {
+            new (&to.value) value_type(std::move(from.value));
+        }
+
+        from.value.~value_type();
+    }
+
+    /**
+     * Take the settings of another map, for an assignment to this empty map.
+     *     The removal listener is not one of them.
+     * @return the current time of the other map if it has timers, to tell
+     *     its expired entries, else 0
+     */
+    std::uint64_t copySettings(const EvictingCacheMap & other) {
+        capacity = other.capacity;
+        maxWeight = other.maxWeight;
+        hasher = other.hasher;
+        weigher = other.weigher;
+        clock = other.clock;
+        defaultTtl = other.defaultTtl;
+        policy = other.policy;
+        policy.clear();
+        index.setLimit(capacity);
+        index.setIncremental(other.index.isIncremental(), slotHash());
+        index.setMaxLoadFactor(other.index.getMaxLoadFactor(), slotHash());
+
+        std::uint64_t time = 0;
+        if (other.timers.started()) {
+            time = other.now();
+            startTimers(time);
+        }
+
+        return time;
+    }
+
+    /**
+     * Copy the slot array of another map, values, links and state, slot for
+     *     slot
+     * @return the copy, with storage from the allocator of this map
+     */
+    SlotVector copySlots(const EvictingCacheMap & other) {
+        SlotVector newSlots(other.slots.size(), slots.get_allocator());
+
+        std::uint32_t i = 0;
+        try {
+            for (; i < other.used; ++i) {
+                auto & from = other.slots[i];
+                auto & to = newSlots[i];
+
+                if (from.prev != FREE)
+                    construct(&to.value, from.value);
+
+                to.prev = from.prev;
+                to.next = from.next;
+                copyState(to, from);
+            }
+        } catch (...) {
+            for (std::uint32_t j = 0; j < i; ++j) {
+                if (newSlots[j].prev != FREE)
+                    newSlots[j].value.~value_type();
+            }
+            throw;
+        }
+
+        return newSlots;
+    }
+
+    /**
+     * Put the live entries of another map, in eviction order
+     * @param valueOf function returning the value of an entry, as a const or
+     *     rvalue reference
+     */
+    template <class TOther, class TValueOf>
+    void mergeEntries(TOther & other, TValueOf && valueOf) {
+        if (&other == this || capacity == 0)
+            return;
+
+        std::uint64_t time = 0;
+        if (other.timers.started()) {
+            time = other.now();
+            if (!timers.started())
+                startTimers(now());
+        }
+
+        reserve(count + other.count);
+
+        for (auto slot = other.tail; slot != NIL; slot = other.slots[slot].prev) {
+            if (other.timers.started() && other.timers.expired(slot, time))
+                continue;
+
+            auto & kv = other.slots[slot].value;
+            auto hash = std::is_empty<THash>::value ? other.hashOf(slot) : hasher(kv.first);
+            auto to = putFor(kv.first, hash, kv.first, valueOf(kv), defaultTtl);
+
+            if (to != NIL && other.timers.started() && other.timers.expiry(slot) != TimerWheel::NEVER)
+                timers.schedule(to, other.timers.expiry(slot));
+        }
+
+        notify();
+    }
+
+    /**
+     * Remove the entries expired at a time without notifying them, as a copy
+     *     would not have taken them
+     * @param time current time of the map copied from, 0 without timers
+     */
+    void dropExpired(std::uint64_t time) {
+        if (!timers.started())
+            return;
+
+        auto wasRecording = std::exchange(recording, false);
+        for (auto slot = head; slot != NIL;) {
+            auto next = slots[slot].next;
+            if (timers.expired(slot, time))
+                remove(slot, RemovalCause::EXPIRED);
+            slot = next;
+        }
+        recording = wasRecording;
+    }
+
+    /**
+     * Move assignment from a map whose storage cannot be taken over: the
+     *     entries are moved one by one, in eviction order, with their
+     *     weights and expiries, and the other map is left empty
+     */
+    void moveEntries(EvictingCacheMap & other) {
+        clearSlots();
+        auto time = copySettings(other);
+        listener = std::move(other.listener);
+        recording = std::exchange(other.recording, false);
+        reserve(other.count);
+
+        for (auto slot = other.tail; slot != NIL; slot = other.slots[slot].prev) {
+            if (timers.started() && other.timers.expired(slot, time))
+                continue;
+
+            auto hash = other.hashOf(slot);
+            auto expiry = timers.started() ? other.timers.expiry(slot) : TimerWheel::NEVER;
+            auto entry = other.extract(slot);
+            insert(hash, expiry, other.slots[slot].weight, [&](value_type * to) {
+                construct(to, std::move(entry.first), std::move(entry.second));
+            });
+        }
+
+        counters = other.counters;
+        other.clearSlots();
+    }
+
+    /**
+     * Destroy the entries and reset the map to empty, without notifications
+     */
+    void clearSlots() {
+        destroyValues();
+
+        head = NIL;
+        tail = NIL;
+        freeHead = NIL;
+        used = 0;
+        count = 0;
+        weight = 0;
+
+        index.clear();
+        policy.clear();
+        timers.clear();
+    }
+
+    void destroyValues() noexcept {
+        for (auto slot = head; slot != NIL; slot = slots[slot].next) {
+            slots[slot].value.~value_type();
+        }
+    }
+};
+
+#ifdef LRU_HAS_PMR
+/**
+ * EvictingCacheMap whose storage, and keys and values such as
+ *     std::pmr::string, come from a std::pmr::memory_resource given to the
+ *     constructor, e.g. one per cache
+ */
+template <class TKey, class TValue, class THash = std::hash<TKey>,
+        class TPolicy = LruPolicy, class TWeigher = UnitWeigher,
+        class TClock = std::chrono::steady_clock, class TStats = NoStats>
+using PmrEvictingCacheMap = EvictingCacheMap<TKey, TValue, THash, TPolicy, TWeigher, TClock, TStats,
+        std::pmr::polymorphic_allocator<std::pair<const TKey, TValue>>>;
+#endif
 
 #endif //LRU_EVICTINGCACHEMAP_H
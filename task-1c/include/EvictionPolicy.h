@@ -0,0 +1,704 @@
+#ifndef LRU_EVICTIONPOLICY_H
+#define LRU_EVICTIONPOLICY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <unordered_map>
+#include <utility>
+
+#include "FrequencySketch.h"
+
+/**
+ * Eviction policies for EvictingCacheMap.
+ *
+ * A policy decides where entries go in the list of slots kept by the map and
+ *     which one to evict.  Every entry is in one list, which iterators walk
+ *     from head to tail; a policy needing several queues keeps them as
+ *     consecutive runs of that list and remembers where each run starts.
+ *     Hooks receive the list as a TList with these operations:
+ *
+ *     head(), tail(), next(slot), prev(slot)   -- NIL past either end
+ *     pushFront(slot), insertBefore(slot, pos) -- pos NIL appends
+ *     moveToFront(slot), unlink(slot)
+ *     mark(slot)                               -- one byte for the policy
+ *     hash(slot)                               -- hash of the slot key
+ *
+ * and the map calls:
+ *
+ *     onInsert(list, slot, hash)   -- link a new entry
+ *     onHit(list, slot)            -- the entry has been accessed
+ *     onRemove(list, slot)         -- unlink an erased or evicted entry
+ *     victim(list, hash)           -- choose the entry to evict before a new
+ *                                     key of the given hash is inserted
+ *     setCapacity(capacity), clear()
+ *     renumber(newSlotOf)          -- slots have been renumbered
+ */
+class EvictionPolicyBase {
+public:
+    static constexpr const std::uint32_t NIL = UINT32_MAX;
+
+    void setCapacity(std::size_t size) noexcept {
+        capacity = size;
+    }
+
+    void clear() noexcept {
+    }
+
+    template <class TRenumber>
+    void renumber(TRenumber &&) noexcept {
+    }
+
+protected:
+    std::size_t capacity = 0;
+
+    template <class TRenumber>
+    static void renumberSlot(std::uint32_t & slot, TRenumber & newSlotOf) {
+        if (slot != NIL)
+            slot = newSlotOf(slot);
+    }
+};
+
+/**
+ * Bounded FIFO of key hashes of recently evicted entries, for policies
+ *     which react to keys coming back soon after their eviction.  Hashes
+ *     stand for keys, so a collision may be taken for a returning key.
+ */
+class GhostList final {
+public:
+    explicit GhostList(std::size_t limit = 0)
+            : limit(limit) {
+    }
+
+    void setLimit(std::size_t size) {
+        limit = size;
+        trim();
+    }
+
+    void insert(std::size_t hash) {
+        auto sequence = ++lastSequence;
+        members[hash] = sequence;
+        queue.emplace_back(hash, sequence);
+
+        trim();
+    }
+
+    bool contains(std::size_t hash) const {
+        return members.count(hash) != 0;
+    }
+
+    /**
+     * Forget a hash
+     * @return true if it was in the list
+     */
+    bool erase(std::size_t hash) {
+        return members.erase(hash) != 0;
+    }
+
+    std::size_t size() const noexcept {
+        return members.size();
+    }
+
+    void clear() noexcept {
+        members.clear();
+        queue.clear();
+    }
+
+private:
+    std::size_t limit;
+
+    //  the queue keeps erased and re-inserted hashes until they reach its
+    //  front; members tells the live ones by their latest sequence number
+    std::unordered_map<std::size_t, std::uint64_t> members;
+    std::deque<std::pair<std::size_t, std::uint64_t>> queue;
+    std::uint64_t lastSequence = 0;
+
+    void trim() {
+        while (!queue.empty() && (members.size() > limit || queue.size() > 2 * limit + 1)) {
+            auto front = queue.front();
+            queue.pop_front();
+
+            auto it = members.find(front.first);
+            if (it != members.end() && it->second == front.second)
+                members.erase(it);
+        }
+    }
+};
+
+/**
+ * Least recently used: hits move the entry to the head, the tail is evicted
+ */
+class LruPolicy final : public EvictionPolicyBase {
+public:
+    template <class TList>
+    void onInsert(TList & list, std::uint32_t slot, std::size_t) {
+        list.pushFront(slot);
+    }
+
+    template <class TList>
+    void onHit(TList & list, std::uint32_t slot) {
+        list.moveToFront(slot);
+    }
+
+    template <class TList>
+    void onRemove(TList & list, std::uint32_t slot) {
+        list.unlink(slot);
+    }
+
+    template <class TList>
+    std::uint32_t victim(TList & list, std::size_t) {
+        return list.tail();
+    }
+};
+
+/**
+ * CLOCK (second chance): the list is a circle swept by a hand, and a hit
+ *     only sets the reference bit of the entry, without relinking anything.
+ *     The hand evicts the first entry without the bit, clearing the bits it
+ *     passes.  New entries are linked just behind the hand.  Iteration order
+ *     follows the circle, not recency.
+ */
+class ClockPolicy final : public EvictionPolicyBase {
+public:
+    template <class TList>
+    void onInsert(TList & list, std::uint32_t slot, std::size_t) {
+        list.insertBefore(slot, hand);
+        list.mark(slot) = 0;
+
+        if (hand == NIL)
+            hand = slot;
+    }
+
+    template <class TList>
+    void onHit(TList & list, std::uint32_t slot) {
+        list.mark(slot) = 1;
+    }
+
+    template <class TList>
+    void onRemove(TList & list, std::uint32_t slot) {
+        if (slot == hand) {
+            hand = advance(list, slot);
+            if (hand == slot)
+                hand = NIL;
+        }
+
+        list.unlink(slot);
+    }
+
+    template <class TList>
+    std::uint32_t victim(TList & list, std::size_t) {
+        while (list.mark(hand) != 0) {
+            list.mark(hand) = 0;
+            hand = advance(list, hand);
+        }
+
+        return hand;
+    }
+
+    void clear() noexcept {
+        hand = NIL;
+    }
+
+    template <class TRenumber>
+    void renumber(TRenumber && newSlotOf) {
+        renumberSlot(hand, newSlotOf);
+    }
+
+private:
+    std::uint32_t hand = NIL;
+
+    template <class TList>
+    static std::uint32_t advance(TList & list, std::uint32_t slot) {
+        auto next = list.next(slot);
+        return (next == NIL) ? list.head() : next;
+    }
+};
+
+/**
+ * Segmented LRU: new entries start in a probation segment and move to a
+ *     protected one on their first hit.  Entries falling off the protected
+ *     segment go back to the head of probation, and only probation entries
+ *     are evicted while there are any, so a scan of new keys cannot flush
+ *     entries that were accessed at least twice.
+ *
+ * The list holds the protected segment followed by the probation one.
+ */
+class SlruPolicy final : public EvictionPolicyBase {
+public:
+    static constexpr const std::size_t PROTECTED_PERCENT = 80;
+
+    template <class TList>
+    void onInsert(TList & list, std::uint32_t slot, std::size_t) {
+        list.insertBefore(slot, probationHead);
+        list.mark(slot) = PROBATION;
+        probationHead = slot;
+    }
+
+    template <class TList>
+    void onHit(TList & list, std::uint32_t slot) {
+        if (list.mark(slot) == PROTECTED) {
+            list.moveToFront(slot);
+            return;
+        }
+
+        if (slot == probationHead)
+            probationHead = list.next(slot);
+
+        list.moveToFront(slot);
+        list.mark(slot) = PROTECTED;
+        ++protectedCount;
+
+        if (protectedCount > capacity * PROTECTED_PERCENT / 100) {
+            //  the protected tail is just in front of probation: moving the
+            //  boundary demotes it
+            auto demoted = (probationHead == NIL) ? list.tail() : list.prev(probationHead);
+            list.mark(demoted) = PROBATION;
+            probationHead = demoted;
+            --protectedCount;
+        }
+    }
+
+    template <class TList>
+    void onRemove(TList & list, std::uint32_t slot) {
+        if (slot == probationHead)
+            probationHead = list.next(slot);
+
+        if (list.mark(slot) == PROTECTED)
+            --protectedCount;
+
+        list.unlink(slot);
+    }
+
+    template <class TList>
+    std::uint32_t victim(TList & list, std::size_t) {
+        return list.tail();
+    }
+
+    void clear() noexcept {
+        probationHead = NIL;
+        protectedCount = 0;
+    }
+
+    template <class TRenumber>
+    void renumber(TRenumber && newSlotOf) {
+        renumberSlot(probationHead, newSlotOf);
+    }
+
+private:
+    static constexpr const std::uint8_t PROBATION = 0;
+    static constexpr const std::uint8_t PROTECTED = 1;
+
+    std::uint32_t probationHead = NIL;
+    std::size_t protectedCount = 0;
+};
+
+/**
+ * 2Q: new entries go to a FIFO (A1in) where hits do not move them.  Keys
+ *     evicted from the FIFO are remembered in a ghost list (A1out), and only
+ *     a key coming back while still remembered enters the main LRU (Am).
+ *     The FIFO is evicted first while it holds more than its share.
+ *
+ * The list holds Am followed by A1in.
+ */
+class TwoQueuePolicy final : public EvictionPolicyBase {
+public:
+    static constexpr const std::size_t IN_PERCENT = 25;
+    static constexpr const std::size_t OUT_PERCENT = 50;
+
+    template <class TList>
+    void onInsert(TList & list, std::uint32_t slot, std::size_t hash) {
+        if (ghosts.erase(hash)) {
+            list.pushFront(slot);
+            list.mark(slot) = MAIN;
+            return;
+        }
+
+        list.insertBefore(slot, inHead);
+        list.mark(slot) = IN;
+        inHead = slot;
+        ++inCount;
+    }
+
+    template <class TList>
+    void onHit(TList & list, std::uint32_t slot) {
+        if (list.mark(slot) == MAIN)
+            list.moveToFront(slot);
+    }
+
+    template <class TList>
+    void onRemove(TList & list, std::uint32_t slot) {
+        if (slot == inHead)
+            inHead = list.next(slot);
+
+        if (list.mark(slot) == IN)
+            --inCount;
+
+        list.unlink(slot);
+    }
+
+    template <class TList>
+    std::uint32_t victim(TList & list, std::size_t) {
+        bool mainEmpty = (inHead == list.head());
+        if (inCount > 0 && (mainEmpty || inCount > capacity * IN_PERCENT / 100)) {
+            auto slot = list.tail();
+            ghosts.insert(list.hash(slot));
+            return slot;
+        }
+
+        return (inHead == NIL) ? list.tail() : list.prev(inHead);
+    }
+
+    void setCapacity(std::size_t size) {
+        capacity = size;
+        ghosts.setLimit(std::max<std::size_t>(1, size * OUT_PERCENT / 100));
+    }
+
+    void clear() noexcept {
+        inHead = NIL;
+        inCount = 0;
+        ghosts.clear();
+    }
+
+    template <class TRenumber>
+    void renumber(TRenumber && newSlotOf) {
+        renumberSlot(inHead, newSlotOf);
+    }
+
+private:
+    static constexpr const std::uint8_t IN = 0;
+    static constexpr const std::uint8_t MAIN = 1;
+
+    std::uint32_t inHead = NIL;
+    std::size_t inCount = 0;
+
+    GhostList ghosts;
+};
+
+/**
+ * Adaptive Replacement Cache: entries seen once (T1) and entries seen at
+ *     least twice (T2) are kept in two LRUs, and ghost lists of keys recently
+ *     evicted from each (B1, B2) steer the target size of T1.  A returning
+ *     ghost from B1 grows the target, one from B2 shrinks it, so the policy
+ *     adapts between recency and frequency.  Each ghost list remembers up to
+ *     capacity keys.
+ *
+ * The list holds T2 followed by T1.
+ */
+class ArcPolicy final : public EvictionPolicyBase {
+public:
+    template <class TList>
+    void onInsert(TList & list, std::uint32_t slot, std::size_t hash) {
+        adapt(hash);
+        adapted = false;
+
+        if (recentGhosts.erase(hash) || frequentGhosts.erase(hash)) {
+            list.pushFront(slot);
+            list.mark(slot) = FREQUENT;
+            ++frequentCount;
+            return;
+        }
+
+        list.insertBefore(slot, recentHead);
+        list.mark(slot) = RECENT;
+        recentHead = slot;
+        ++recentCount;
+    }
+
+    template <class TList>
+    void onHit(TList & list, std::uint32_t slot) {
+        if (list.mark(slot) == RECENT) {
+            if (slot == recentHead)
+                recentHead = list.next(slot);
+
+            list.mark(slot) = FREQUENT;
+            --recentCount;
+            ++frequentCount;
+        }
+
+        list.moveToFront(slot);
+    }
+
+    template <class TList>
+    void onRemove(TList & list, std::uint32_t slot) {
+        if (slot == recentHead)
+            recentHead = list.next(slot);
+
+        if (list.mark(slot) == RECENT)
+            --recentCount;
+        else
+            --frequentCount;
+
+        list.unlink(slot);
+    }
+
+    /**
+     * REPLACE of the ARC paper; the target adaptation for the incoming key
+     *     happens here, before the choice, and is not repeated on insertion
+     */
+    template <class TList>
+    std::uint32_t victim(TList & list, std::size_t hash) {
+        adapt(hash);
+
+        bool fromRecent = recentCount > 0
+                && (frequentCount == 0
+                    || recentCount > target
+                    || (recentCount == target && frequentGhosts.contains(hash)));
+
+        if (fromRecent) {
+            auto slot = list.tail();
+            recentGhosts.insert(list.hash(slot));
+            return slot;
+        }
+
+        auto slot = (recentHead == NIL) ? list.tail() : list.prev(recentHead);
+        frequentGhosts.insert(list.hash(slot));
+        return slot;
+    }
+
+    void setCapacity(std::size_t size) {
+        capacity = size;
+        target = std::min(target, size);
+        recentGhosts.setLimit(size);
+        frequentGhosts.setLimit(size);
+    }
+
+    void clear() noexcept {
+        recentHead = NIL;
+        recentCount = 0;
+        frequentCount = 0;
+        target = 0;
+        adapted = false;
+        recentGhosts.clear();
+        frequentGhosts.clear();
+    }
+
+    template <class TRenumber>
+    void renumber(TRenumber && newSlotOf) {
+        renumberSlot(recentHead, newSlotOf);
+    }
+
+    /**
+     * Target size of T1, for inspection
+     */
+    std::size_t getTarget() const noexcept {
+        return target;
+    }
+
+private:
+    static constexpr const std::uint8_t RECENT = 0;
+    static constexpr const std::uint8_t FREQUENT = 1;
+
+    std::uint32_t recentHead = NIL;
+    std::size_t recentCount = 0;
+    std::size_t frequentCount = 0;
+
+    std::size_t target = 0;
+
+    bool adapted = false;           //  adapt() already ran for adaptedHash
+    std::size_t adaptedHash = 0;
+
+    GhostList recentGhosts;
+    GhostList frequentGhosts;
+
+    void adapt(std::size_t hash) {
+        if (adapted && adaptedHash == hash)
+            return;
+
+        adapted = true;
+        adaptedHash = hash;
+
+        if (recentGhosts.contains(hash)) {
+            auto delta = std::max<std::size_t>(1, frequentGhosts.size() / recentGhosts.size());
+            target = std::min(capacity, target + delta);
+        } else if (frequentGhosts.contains(hash)) {
+            auto delta = std::max<std::size_t>(1, recentGhosts.size() / frequentGhosts.size());
+            target -= std::min(target, delta);
+        }
+    }
+};
+
+/**
+ * Window TinyLFU: new entries go to a small LRU window; entries pushed out
+ *     of it compete with the eviction victim of the main SLRU region, and
+ *     only enter it if a FrequencySketch of recent accesses (hits and
+ *     inserts) says they are used more often than the victim.  Otherwise the
+ *     candidate itself is evicted, so one-hit wonders pass through the
+ *     window without flushing the main region.  The window keeps bursts of
+ *     new keys from being rejected before they had a chance to be hit.
+ *
+ * The list holds the window, then the protected and probation segments of
+ *     the main region.  clear() forgets the entries but keeps the frequency
+ *     history.
+ */
+class WTinyLfuPolicy final : public EvictionPolicyBase {
+public:
+    static constexpr const std::size_t WINDOW_PERCENT = 1;
+    static constexpr const std::size_t PROTECTED_PERCENT = 80;
+
+    template <class TList>
+    void onInsert(TList & list, std::uint32_t slot, std::size_t hash) {
+        sketch.increment(hash);
+
+        list.pushFront(slot);
+        list.mark(slot) = WINDOW;
+        ++windowCount;
+
+        //  the cache is not full yet: the window overflows into probation
+        //  without a contest
+        if (windowCount > windowMax)
+            admit(list, windowTail(list));
+    }
+
+    template <class TList>
+    void onHit(TList & list, std::uint32_t slot) {
+        sketch.increment(list.hash(slot));
+
+        switch (list.mark(slot)) {
+            case WINDOW:
+                list.moveToFront(slot);
+                break;
+            case PROBATION:
+                if (slot == probationHead)
+                    probationHead = list.next(slot);
+
+                toProtectedHead(list, slot);
+                list.mark(slot) = PROTECTED;
+                ++protectedCount;
+
+                if (protectedCount > protectedMax) {
+                    auto demoted = (probationHead == NIL) ? list.tail() : list.prev(probationHead);
+                    list.mark(demoted) = PROBATION;
+                    probationHead = demoted;
+                    --protectedCount;
+                }
+                break;
+            default:
+                toProtectedHead(list, slot);
+        }
+    }
+
+    template <class TList>
+    void onRemove(TList & list, std::uint32_t slot) {
+        if (slot == mainHead)
+            mainHead = list.next(slot);
+
+        if (slot == probationHead)
+            probationHead = list.next(slot);
+
+        switch (list.mark(slot)) {
+            case WINDOW:
+                --windowCount;
+                break;
+            case PROTECTED:
+                --protectedCount;
+                break;
+            default:
+                break;
+        }
+
+        list.unlink(slot);
+    }
+
+    /**
+     * When the window is full, the incoming key pushes its tail out: the
+     *     tail and the main victim are compared and the less frequent one is
+     *     evicted.  Otherwise the window grows and the main region gives up
+     *     its victim.
+     */
+    template <class TList>
+    std::uint32_t victim(TList & list, std::size_t) {
+        if (mainHead == NIL)
+            return list.tail();
+
+        auto mainVictim = list.tail();
+        if (windowCount < windowMax)
+            return mainVictim;
+
+        auto candidate = windowTail(list);
+        if (sketch.frequency(list.hash(candidate)) <= sketch.frequency(list.hash(mainVictim)))
+            return candidate;
+
+        admit(list, candidate);
+        return mainVictim;
+    }
+
+    void setCapacity(std::size_t size) {
+        capacity = size;
+        windowMax = std::max<std::size_t>(1, size * WINDOW_PERCENT / 100);
+        protectedMax = (size > windowMax) ? (size - windowMax) * PROTECTED_PERCENT / 100 : 0;
+        sketch.setSize(size);
+    }
+
+    void clear() noexcept {
+        mainHead = NIL;
+        probationHead = NIL;
+        windowCount = 0;
+        protectedCount = 0;
+    }
+
+    template <class TRenumber>
+    void renumber(TRenumber && newSlotOf) {
+        renumberSlot(mainHead, newSlotOf);
+        renumberSlot(probationHead, newSlotOf);
+    }
+
+    const FrequencySketch & getSketch() const noexcept {
+        return sketch;
+    }
+
+private:
+    static constexpr const std::uint8_t WINDOW = 0;
+    static constexpr const std::uint8_t PROBATION = 1;
+    static constexpr const std::uint8_t PROTECTED = 2;
+
+    std::uint32_t mainHead = NIL;       //  first protected or probation entry
+    std::uint32_t probationHead = NIL;
+
+    std::size_t windowCount = 0;
+    std::size_t windowMax = 1;
+    std::size_t protectedCount = 0;
+    std::size_t protectedMax = 0;
+
+    FrequencySketch sketch;
+
+    template <class TList>
+    std::uint32_t windowTail(TList & list) const {
+        return (mainHead == NIL) ? list.tail() : list.prev(mainHead);
+    }
+
+    /**
+     * Move a main region entry to the head of the protected segment
+     */
+    template <class TList>
+    void toProtectedHead(TList & list, std::uint32_t slot) {
+        if (slot == mainHead)
+            return;
+
+        list.unlink(slot);
+        list.insertBefore(slot, mainHead);
+        mainHead = slot;
+    }
+
+    /**
+     * Move the window tail to the head of probation
+     */
+    template <class TList>
+    void admit(TList & list, std::uint32_t slot) {
+        list.mark(slot) = PROBATION;
+        --windowCount;
+
+        if (protectedCount == 0) {
+            //  the window tail already sits in front of probation
+            mainHead = slot;
+            probationHead = slot;
+            return;
+        }
+
+        list.unlink(slot);
+        list.insertBefore(slot, probationHead);
+        probationHead = slot;
+    }
+};
+
+#endif //LRU_EVICTIONPOLICY_H
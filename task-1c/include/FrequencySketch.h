@@ -0,0 +1,153 @@
+#ifndef LRU_FREQUENCYSKETCH_H
+#define LRU_FREQUENCYSKETCH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Count-min sketch estimating how often key hashes have been seen recently,
+ *     with 4-bit saturating counters.  Each hash owns four counters in four
+ *     different 64-bit words, and its frequency is the smallest of them, so
+ *     collisions can only overestimate it.
+ *
+ * Once the number of increments reaches the sample size (ten times the
+ *     expected number of distinct keys) every counter is halved, so that the
+ *     estimates follow the workload instead of its whole history.
+ */
+class FrequencySketch final {
+public:
+    static constexpr const std::uint8_t MAX_FREQUENCY = 15;
+
+    /**
+     * Size the sketch for a number of distinct keys.  Counters are reset.
+     * @param size expected number of distinct keys, usually the capacity
+     */
+    void setSize(std::size_t size) {
+        std::size_t words = MIN_WORDS;
+        while (words < size)
+            words *= 2;
+
+        table.assign(words, 0);
+        mask = words - 1;
+        sampleSize = (size == 0) ? SAMPLE_FACTOR : SAMPLE_FACTOR * size;
+        additions = 0;
+    }
+
+    /**
+     * Record an occurrence of a hash
+     * @param hash key hash
+     */
+    void increment(std::size_t hash) noexcept {
+        if (table.empty())
+            return;
+
+        auto spread = rehash(hash);
+        auto start = (spread & 3) << 2;
+
+        bool added = false;
+        for (unsigned i = 0; i < DEPTH; ++i) {
+            added |= incrementAt(indexOf(spread, i), (start + i) << 2);
+        }
+
+        if (added && ++additions >= sampleSize)
+            reset();
+    }
+
+    /**
+     * Estimate how often a hash has been seen
+     * @param hash key hash
+     * @return the estimate, at most MAX_FREQUENCY
+     */
+    std::uint8_t frequency(std::size_t hash) const noexcept {
+        if (table.empty())
+            return 0;
+
+        auto spread = rehash(hash);
+        auto start = (spread & 3) << 2;
+
+        auto result = MAX_FREQUENCY;
+        for (unsigned i = 0; i < DEPTH; ++i) {
+            auto offset = (start + i) << 2;
+            auto count = static_cast<std::uint8_t>((table[indexOf(spread, i)] >> offset) & 0xF);
+            if (count < result)
+                result = count;
+        }
+
+        return result;
+    }
+
+    /**
+     * Halve every counter
+     */
+    void reset() noexcept {
+        std::size_t odd = 0;
+        for (auto & word : table) {
+            odd += popcount(word & ONE_MASK);
+            word = (word >> 1) & RESET_MASK;
+        }
+
+        //  each increment touched four counters: the truncated halves are
+        //  worth a quarter of an addition each
+        additions = (additions - odd / 4) / 2;
+    }
+
+    void clear() noexcept {
+        std::fill(table.begin(), table.end(), 0);
+        additions = 0;
+    }
+
+private:
+    static constexpr const unsigned DEPTH = 4;
+    static constexpr const std::size_t MIN_WORDS = 8;
+    static constexpr const std::size_t SAMPLE_FACTOR = 10;
+
+    static constexpr const std::uint64_t RESET_MASK = 0x7777777777777777ull;
+    static constexpr const std::uint64_t ONE_MASK = 0x1111111111111111ull;
+
+    static constexpr const std::uint64_t SEEDS[DEPTH] = {
+            0xC3A5C85C97CB3127ull, 0xB492B66FBE98F273ull,
+            0x9AE16A3B2F90404Full, 0xCBF29CE484222325ull
+    };
+
+    std::vector<std::uint64_t> table;
+    std::size_t mask = 0;
+
+    std::size_t sampleSize = 0;
+    std::size_t additions = 0;
+
+    /**
+     * Scramble the user hash, which is the identity for integers with
+     *     std::hash
+     */
+    static std::uint64_t rehash(std::size_t hash) noexcept {
+        auto h = static_cast<std::uint64_t>(hash) * 0x9E3779B97F4A7C15ull;
+        return h ^ (h >> 29);
+    }
+
+    std::size_t indexOf(std::uint64_t spread, unsigned i) const noexcept {
+        auto h = (spread + SEEDS[i]) * SEEDS[i];
+        h += h >> 32;
+        return static_cast<std::size_t>(h) & mask;
+    }
+
+    bool incrementAt(std::size_t i, unsigned offset) noexcept {
+        auto counter = std::uint64_t(0xF) << offset;
+        if ((table[i] & counter) == counter)
+            return false;
+
+        table[i] += std::uint64_t(1) << offset;
+        return true;
+    }
+
+    static unsigned popcount(std::uint64_t x) noexcept {
+        unsigned count = 0;
+        for (; x != 0; x &= x - 1)
+            ++count;
+
+        return count;
+    }
+};
+
+#endif //LRU_FREQUENCYSKETCH_H
@@ -0,0 +1,217 @@
+#ifndef LRU_MISSRATIOCURVE_H
+#define LRU_MISSRATIOCURVE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Miss ratio of an LRU cache at every capacity, from one pass over a trace.
+ *     The stack distance of an access is the number of distinct keys used
+ *     since the previous access of its key, itself included: an LRU cache
+ *     of capacity c hits exactly the accesses at distance c or less, so the
+ *     histogram of the distances gives the whole curve.
+ *
+ * The last access of every key is marked in a Fenwick tree over time, which
+ *     counts the distinct keys of an interval in O(log n); the times are
+ *     renumbered whenever the tree is full, so its size follows the number
+ *     of distinct keys rather than the length of the trace.
+ *
+ * With a sampling rate below 1 only the keys whose hash falls under the rate
+ *     are followed, as in SHARDS (Waldspurger et al., FAST '15): distances
+ *     are scaled up by 1 / rate, and memory and time drop by the rate, at
+ *     the cost of some accuracy at capacities of less than about 1 / rate
+ *     keys.  The count of sampled accesses is corrected to the expected one
+ *     (SHARDS-adj).
+ */
+class MissRatioCurve final {
+public:
+    /**
+     * Construct a MissRatioCurve
+     * @param samplingRate share of the keys to follow, in (0, 1]
+     */
+    explicit MissRatioCurve(double samplingRate = 1.0) {
+        if (!(samplingRate > 0.0 && samplingRate <= 1.0))
+            throw std::invalid_argument("sampling rate must be in (0, 1]");
+
+        threshold = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(samplingRate * SAMPLE_SPACE));
+        tree.assign(MIN_TREE_SIZE + 1, 0);
+    }
+
+    /**
+     * Record an access
+     * @param key identifier of the key, e.g. a hash of it; equal keys must
+     *     have equal identifiers
+     */
+    void access(std::uint64_t key) {
+        ++total;
+        if ((mix(key) & (SAMPLE_SPACE - 1)) >= threshold)
+            return;
+
+        ++sampled;
+        if (time + 1 == tree.size())
+            compact();
+
+        auto it = last.find(key);
+        if (it != last.end()) {
+            auto distance = countMarks(it->second + 1, time) + 1;
+            add(it->second, -1);
+            record(distance);
+            it->second = time;
+        } else {
+            last.emplace(key, time);
+        }
+
+        add(time++, 1);
+    }
+
+    /**
+     * Get the miss ratio of an LRU cache, cold misses included
+     * @param capacity number of entries of the cache
+     * @return the ratio of misses to accesses, 0 without accesses
+     */
+    double missRatio(std::size_t capacity) const {
+        return (total == 0) ? 0.0 : misses(capacity) / static_cast<double>(total);
+    }
+
+    /**
+     * Get the estimated number of misses of an LRU cache, exact without
+     *     sampling
+     * @param capacity number of entries of the cache
+     * @return the number of misses over all accesses
+     */
+    double misses(std::size_t capacity) const {
+        if (capacity == 0)
+            return static_cast<double>(total);
+
+        std::uint64_t hits = 0;
+        auto end = std::min(capacity + 1, histogram.size());
+        for (std::size_t i = 1; i < end; ++i) {
+            hits += histogram[i];
+        }
+
+        //  the sampled misses scaled up: SHARDS-adj, whose correction of the
+        //  sampled count applies to the hits only
+        return std::min(static_cast<double>(sampled - hits) / rate(), static_cast<double>(total));
+    }
+
+    /**
+     * Get the number of recorded accesses, sampled or not
+     */
+    std::uint64_t accesses() const noexcept {
+        return total;
+    }
+
+    /**
+     * Get the estimated number of distinct keys, the capacity from which
+     *     only cold misses are left
+     */
+    std::size_t distinctKeys() const noexcept {
+        return static_cast<std::size_t>(std::ceil(last.size() / rate()));
+    }
+
+    /**
+     * Get the effective sampling rate, the one asked for rounded to the
+     *     resolution of the hash test
+     */
+    double rate() const noexcept {
+        return static_cast<double>(threshold) / SAMPLE_SPACE;
+    }
+
+private:
+    static constexpr const std::uint64_t SAMPLE_SPACE = std::uint64_t(1) << 24;
+    static constexpr const std::size_t MIN_TREE_SIZE = 1 << 16;
+
+    std::uint64_t threshold;
+    std::uint64_t total = 0;
+    std::uint64_t sampled = 0;
+
+    std::unordered_map<std::uint64_t, std::size_t> last;   //  time of the last access of each key
+    std::vector<std::int64_t> tree;     //  1-based Fenwick tree marking last accesses
+    std::size_t time = 0;
+
+    std::vector<std::uint64_t> histogram;   //  accesses by (scaled) stack distance
+
+    /**
+     * splitmix64 finalizer, so that sampling does not depend on the quality
+     *     of the key identifiers
+     */
+    static std::uint64_t mix(std::uint64_t x) noexcept {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    }
+
+    void record(std::size_t distance) {
+        auto bin = static_cast<std::size_t>(std::ceil(distance / rate()));
+        if (bin >= histogram.size())
+            histogram.resize(std::max(bin + 1, 2 * histogram.size()), 0);
+
+        ++histogram[bin];
+    }
+
+    void add(std::size_t position, std::int64_t delta) noexcept {
+        for (auto i = position + 1; i < tree.size(); i += i & (~i + 1)) {
+            tree[i] += delta;
+        }
+    }
+
+    /**
+     * Count the marks in [0, end)
+     */
+    std::int64_t prefix(std::size_t end) const noexcept {
+        std::int64_t sum = 0;
+        for (auto i = end; i > 0; i -= i & (~i + 1)) {
+            sum += tree[i];
+        }
+
+        return sum;
+    }
+
+    std::size_t countMarks(std::size_t begin, std::size_t end) const noexcept {
+        return static_cast<std::size_t>(prefix(end) - prefix(begin));
+    }
+
+    /**
+     * Renumber the last accesses 0, 1, ... in time order, growing the tree
+     *     so that at least half of it is free afterwards
+     */
+    void compact() {
+        std::vector<std::pair<std::size_t, std::uint64_t>> order;
+        order.reserve(last.size());
+        for (auto & entry : last) {
+            order.emplace_back(entry.second, entry.first);
+        }
+        std::sort(order.begin(), order.end());
+
+        auto size = tree.size() - 1;
+        while (size < 2 * order.size()) {
+            size *= 2;
+        }
+
+        for (std::size_t i = 0; i < order.size(); ++i) {
+            last[order[i].second] = i;
+        }
+
+        //  linear construction of a tree with the first order.size() positions marked
+        tree.assign(size + 1, 0);
+        for (std::size_t i = 1; i <= size; ++i) {
+            tree[i] += (i <= order.size()) ? 1 : 0;
+            auto parent = i + (i & (~i + 1));
+            if (parent <= size)
+                tree[parent] += tree[i];
+        }
+
+        time = order.size();
+    }
+};
+
+#endif //LRU_MISSRATIOCURVE_H
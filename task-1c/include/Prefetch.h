@@ -0,0 +1,24 @@
+#ifndef LRU_PREFETCH_H
+#define LRU_PREFETCH_H
+
+#if defined(_MSC_VER) && !defined(__clang__) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
+
+/**
+ * Ask the processor to start loading the cache line of an address, so that
+ *     reading it later does not stall.  Only a hint: the address need not be
+ *     valid, and compilers without a prefetch intrinsic do nothing.
+ * @param address address about to be read
+ */
+inline void prefetchRead(const void * address) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(address, 0, 3);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_prefetch(static_cast<const char *>(address), _MM_HINT_T0);
+#else
+    (void) address;
+#endif
+}
+
+#endif //LRU_PREFETCH_H
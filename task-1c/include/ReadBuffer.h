@@ -0,0 +1,61 @@
+#ifndef LRU_READBUFFER_H
+#define LRU_READBUFFER_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+/**
+ * Lossy buffer of reads waiting to be applied to a cache.  Any number of
+ *     threads may record() at once without locking: each one claims a cell
+ *     with a single fetch_add, and records arriving when the buffer is full
+ *     are dropped.  drain() must run while no thread records, which the
+ *     owner guarantees by recording under a shared lock and draining under
+ *     the exclusive one.
+ *
+ * Buffers are aligned to cache lines, so that readers of neighbouring
+ *     buffers do not fight over their write counters.
+ */
+template <class T, std::size_t SIZE>
+class alignas(64) ReadBuffer final {
+public:
+    /**
+     * Record an element
+     * @param element element to record
+     * @return true if the buffer is full after the call, so that it is time
+     *     to drain it
+     */
+    bool record(const T & element) noexcept {
+        auto pos = writes.fetch_add(1, std::memory_order_relaxed);
+        if (pos < SIZE)
+            cells[pos] = element;
+
+        return pos + 1 >= SIZE;
+    }
+
+    /**
+     * Hand the recorded elements, oldest first, to a consumer and empty the
+     *     buffer
+     * @param consumer function called with each element
+     */
+    template <class TConsumer>
+    void drain(TConsumer && consumer) {
+        auto count = std::min(writes.load(std::memory_order_relaxed), SIZE);
+        for (std::size_t i = 0; i < count; ++i) {
+            consumer(cells[i]);
+        }
+
+        writes.store(0, std::memory_order_relaxed);
+    }
+
+    bool empty() const noexcept {
+        return writes.load(std::memory_order_relaxed) == 0;
+    }
+
+private:
+    std::atomic<std::size_t> writes{ 0 };
+    std::array<T, SIZE> cells;
+};
+
+#endif //LRU_READBUFFER_H
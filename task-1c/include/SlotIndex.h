@@ -0,0 +1,629 @@
+#ifndef LRU_SLOTINDEX_H
+#define LRU_SLOTINDEX_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "ControlGroup.h"
+#include "Prefetch.h"
+
+/**
+ * Open-addressing hash index from keys to 32-bit slot numbers.  The index
+ *     never touches the keys itself: lookups take a predicate that compares a
+ *     candidate slot with the searched key, and rehashing takes a function
+ *     that returns the hash of the key stored in a slot.
+ *
+ * Buckets come in groups of 16 with a control byte each, as in Swiss
+ *     tables: the byte holds 7 bits of the hash of the indexed key, or marks
+ *     the bucket empty or deleted.  Groups are probed linearly from the home
+ *     group of a hash, 16 buckets at a time (see ControlGroup), and only the
+ *     buckets whose bits match are handed to the predicate, so most misses
+ *     are decided without looking at a key.  A probe stops at the first
+ *     group with an empty bucket; erased buckets are marked as deleted so
+ *     that probe sequences passing through them stay intact, unless their
+ *     group still has an empty bucket, which no probe goes past.  Growing the
+ *     index either rehashes every bucket at once or, in incremental mode,
+ *     spreads the work over the following operations.
+ *
+ * The buckets come from TAllocator, rebound.
+ */
+template <class TAllocator = std::allocator<std::uint32_t>>
+class BasicSlotIndex final {
+public:
+    static constexpr const std::uint32_t NONE = UINT32_MAX;
+
+    BasicSlotIndex()
+            : BasicSlotIndex(TAllocator()) {
+    }
+
+    explicit BasicSlotIndex(const TAllocator & allocator)
+            : buckets(GroupAllocator(allocator)), oldBuckets(GroupAllocator(allocator)) {
+    }
+
+    /**
+     * Find the slot matching a key
+     * @param hash hash of the key
+     * @param match predicate telling whether a slot holds the key
+     * @return the slot or NONE
+     */
+    template <class TMatch>
+    std::uint32_t find(std::size_t hash, TMatch && match) const {
+        auto slot = probe(buckets, hash, match);
+        if (slot == NONE && migrating())
+            slot = probe(oldBuckets, hash, match);
+
+        return slot;
+    }
+
+    /**
+     * Start loading the home bucket of a hash, ahead of a find()
+     * @param hash hash of a key
+     */
+    void prefetch(std::size_t hash) const noexcept {
+        if (buckets.empty())
+            return;
+
+        auto pos = homeGroup(mix(hash), buckets.mask);
+        prefetchRead(buckets.controls(pos));
+        prefetchRead(&buckets.slot(pos + ControlGroup::SIZE - 1));
+    }
+
+    /**
+     * Get the first slot of the home group of a hash whose control byte
+     *     matches it, without comparing keys.  It is most often the slot of
+     *     the key with that hash, if indexed, so it is worth prefetching.
+     * @param hash hash of a key
+     * @return the slot or NONE if no bucket of the home group matches
+     */
+    std::uint32_t home(std::size_t hash) const noexcept {
+        if (buckets.empty())
+            return NONE;
+
+        auto h = mix(hash);
+        auto pos = homeGroup(h, buckets.mask);
+        auto matches = ControlGroup(buckets.controls(pos)).match(tag(h));
+
+        return (matches == 0) ? NONE : buckets.slot(pos + ControlGroup::lowestBit(matches));
+    }
+
+    /**
+     * Add a slot which is known to be absent from the index
+     * @param hash hash of the slot key
+     * @param slot slot to add
+     * @param hashOf function returning the hash of a slot key, used if the
+     *     index has to grow
+     */
+    template <class THashOf>
+    void insert(std::size_t hash, std::uint32_t slot, THashOf && hashOf) {
+        if ((buckets.occupied + 1) > buckets.size() * maxLoadFactor) {
+            if (migrating())
+                migrate(oldBuckets.size(), hashOf);
+
+            auto count = targetBuckets(live + 1);
+            if (incremental && !buckets.empty())
+                startMigration(count);
+            else
+                rehash(count, hashOf);
+        } else if (migrating()) {
+            migrate(MIGRATION_STEP, hashOf);
+        }
+
+        place(hash, slot);
+        ++live;
+    }
+
+    /**
+     * Remove a slot from the index
+     * @param hash hash of the slot key
+     * @param slot slot to remove
+     * @param hashOf function returning the hash of a slot key, used to
+     *     advance an incremental rehash
+     * @return true if the slot was indexed, else false
+     */
+    template <class THashOf>
+    bool erase(std::size_t hash, std::uint32_t slot, THashOf && hashOf) {
+        if (migrating())
+            migrate(MIGRATION_STEP, hashOf);
+
+        if (!remove(buckets, hash, slot) && !(migrating() && remove(oldBuckets, hash, slot)))
+            return false;
+
+        --live;
+
+        return true;
+    }
+
+    /**
+     * Advance an incremental rehash, if one is in progress, by a bounded
+     *     number of buckets
+     * @param hashOf function returning the hash of a slot key
+     */
+    template <class THashOf>
+    void step(THashOf && hashOf) {
+        if (migrating())
+            migrate(MIGRATION_STEP, hashOf);
+    }
+
+    /**
+     * Choose between rehashing the whole index at once when it grows and
+     *     rehashing it incrementally, in which case the old buckets are kept
+     *     next to the new ones and every insert(), erase() and step() moves at
+     *     most MIGRATION_STEP of them.  Lookups search both bucket arrays
+     *     until the migration is over.
+     * @param enabled true for incremental rehashing
+     * @param hashOf function returning the hash of a slot key, used to finish
+     *     a migration in progress when switching it off
+     */
+    template <class THashOf>
+    void setIncremental(bool enabled, THashOf && hashOf) {
+        if (!enabled && migrating())
+            migrate(oldBuckets.size(), hashOf);
+
+        incremental = enabled;
+    }
+
+    bool isIncremental() const noexcept {
+        return incremental;
+    }
+
+    /**
+     * Set the largest number of slots the index will ever hold.  Growth
+     *     stops at the bucket count needed for that many slots, so that the
+     *     index of a full cache has a fixed, predictable size.
+     * @param maxSize the bound, usually the cache capacity
+     */
+    void setLimit(std::size_t maxSize) noexcept {
+        limit = maxSize;
+    }
+
+    /**
+     * Set the largest ratio of used buckets (live or deleted) to all buckets
+     *     before the index grows or gets cleaned up.  The index is rehashed
+     *     at once if it is already above the new ratio.
+     * @param factor ratio in (0, 1)
+     * @param hashOf function returning the hash of a slot key
+     */
+    template <class THashOf>
+    void setMaxLoadFactor(float factor, THashOf && hashOf) {
+        if (!(factor > 0.0f && factor < 1.0f))
+            throw std::invalid_argument("max load factor must be in (0, 1)");
+
+        maxLoadFactor = factor;
+
+        if (migrating())
+            migrate(oldBuckets.size(), hashOf);
+
+        if (buckets.occupied > buckets.size() * maxLoadFactor)
+            rehash(targetBuckets(live), hashOf);
+    }
+
+    float getMaxLoadFactor() const noexcept {
+        return maxLoadFactor;
+    }
+
+    /**
+     * Allocate the buckets for size slots (at most the limit) up front, so
+     *     that inserting them never rehashes
+     * @param size number of slots
+     * @param hashOf function returning the hash of a slot key
+     */
+    template <class THashOf>
+    void reserve(std::size_t size, THashOf && hashOf) {
+        if (migrating())
+            migrate(oldBuckets.size(), hashOf);
+
+        auto count = targetBuckets(std::max(size, live));
+        if (count > buckets.size())
+            rehash(count, hashOf);
+    }
+
+    /**
+     * Replace the content of the index with the slots [0, size), using the
+     *     smallest bucket count that fits them
+     * @param size number of slots
+     * @param hashOf function returning the hash of a slot key
+     */
+    template <class THashOf>
+    void assign(std::uint32_t size, THashOf && hashOf) {
+        reset();
+        if (size == 0)
+            return;
+
+        buckets = Table(requiredBuckets(size), allocator());
+        for (std::uint32_t slot = 0; slot < size; ++slot) {
+            place(hashOf(slot), slot);
+        }
+
+        live = size;
+    }
+
+    /**
+     * assign() for slots which may hold the same key twice, e.g. read from a
+     *     file
+     * @param size number of slots
+     * @param hashOf function returning the hash of a slot key
+     * @param same predicate telling whether two slots hold the same key; it
+     *     is only called for slots whose hashes are equal
+     * @return true, or false if two slots hold the same key, in which case
+     *     the index is left empty
+     */
+    template <class THashOf, class TSame>
+    bool build(std::uint32_t size, THashOf && hashOf, TSame && same) {
+        reset();
+        if (size == 0)
+            return true;
+
+        buckets = Table(requiredBuckets(size), allocator());
+        for (std::uint32_t slot = 0; slot < size; ++slot) {
+            auto hash = hashOf(slot);
+            auto duplicate = [&](std::uint32_t other) {
+                return hashOf(other) == hash && same(other, slot);
+            };
+
+            if (probe(buckets, hash, duplicate) != NONE) {
+                reset();
+                return false;
+            }
+
+            place(hash, slot);
+        }
+
+        live = size;
+        return true;
+    }
+
+    bool migrating() const noexcept {
+        return !oldBuckets.empty();
+    }
+
+    /**
+     * Remove every slot, keeping the allocated buckets
+     */
+    void clear() noexcept {
+        dropMigration();
+        buckets.clear();
+        live = 0;
+    }
+
+    /**
+     * Drop every slot and release the buckets
+     */
+    void reset() noexcept {
+        dropMigration();
+        buckets = Table(allocator());
+        live = 0;
+    }
+
+    std::size_t size() const noexcept {
+        return live;
+    }
+
+    std::size_t bucketCount() const noexcept {
+        return buckets.size();
+    }
+
+    /**
+     * Number of times the index grew or was cleaned up, all at once or
+     *     incrementally
+     */
+    std::uint64_t rehashCount() const noexcept {
+        return rehashes;
+    }
+
+    /**
+     * Time spent in the rehashes done all at once; incremental ones are
+     *     spread over other operations and not timed
+     */
+    std::chrono::nanoseconds rehashTime() const noexcept {
+        return rehashDuration;
+    }
+
+    /**
+     * Count the groups probed to find each indexed slot, its home group
+     *     included.  It visits every bucket, so it is meant for statistics.
+     * @param hashOf function returning the hash of a slot key
+     * @return the total over all slots
+     */
+    template <class THashOf>
+    std::uint64_t probeCount(THashOf && hashOf) const {
+        return probeCount(buckets, hashOf) + probeCount(oldBuckets, hashOf);
+    }
+
+private:
+    static constexpr const std::size_t MIN_BUCKETS = ControlGroup::SIZE;
+
+    //  a new bucket array has room for live / 2 more entries; unless the old
+    //  one is mostly tombstones it has at most about 4 * live buckets, so the
+    //  migration is over before the new array fills up (insert() finishes it
+    //  at once otherwise)
+    static constexpr const std::size_t MIGRATION_STEP = 16;
+
+    /**
+     * Control bytes of 16 buckets followed by their slots, valid where the
+     *     control byte is a tag
+     */
+    struct Group final {
+        Group() noexcept {
+            std::fill(std::begin(controls), std::end(controls), ControlGroup::EMPTY);
+        }
+
+        std::uint8_t controls[ControlGroup::SIZE];
+        std::uint32_t slots[ControlGroup::SIZE];
+    };
+
+    using GroupAllocator = typename std::allocator_traits<TAllocator>::template rebind_alloc<Group>;
+
+    /**
+     * Bucket array, in groups.  A lookup mostly reads one group, and a group
+     *     spans at most two cache lines.
+     */
+    struct Table final {
+        std::vector<Group, GroupAllocator> groups;
+        std::size_t mask = 0;
+        std::size_t occupied = 0;   //  buckets not empty: live or deleted
+
+        explicit Table(const GroupAllocator & allocator)
+                : groups(allocator) {
+        }
+
+        Table(std::size_t count, const GroupAllocator & allocator)
+                : groups(count / ControlGroup::SIZE, allocator), mask(count - 1) {
+        }
+
+        std::size_t size() const noexcept {
+            return groups.size() * ControlGroup::SIZE;
+        }
+
+        bool empty() const noexcept {
+            return groups.empty();
+        }
+
+        void clear() noexcept {
+            for (auto & group : groups) {
+                std::fill(std::begin(group.controls), std::end(group.controls), ControlGroup::EMPTY);
+            }
+            occupied = 0;
+        }
+
+        /**
+         * Get the control bytes of the group starting at a bucket
+         */
+        const std::uint8_t * controls(std::size_t pos) const noexcept {
+            return groups[pos / ControlGroup::SIZE].controls;
+        }
+
+        std::uint8_t & control(std::size_t pos) noexcept {
+            return groups[pos / ControlGroup::SIZE].controls[pos % ControlGroup::SIZE];
+        }
+
+        std::uint8_t control(std::size_t pos) const noexcept {
+            return groups[pos / ControlGroup::SIZE].controls[pos % ControlGroup::SIZE];
+        }
+
+        std::uint32_t & slot(std::size_t pos) noexcept {
+            return groups[pos / ControlGroup::SIZE].slots[pos % ControlGroup::SIZE];
+        }
+
+        const std::uint32_t & slot(std::size_t pos) const noexcept {
+            return groups[pos / ControlGroup::SIZE].slots[pos % ControlGroup::SIZE];
+        }
+    };
+
+    Table buckets;
+    std::size_t live = 0;       //  in both bucket arrays
+
+    float maxLoadFactor = 0.5f;
+    std::size_t limit = SIZE_MAX / 2;
+
+    bool incremental = false;
+
+    Table oldBuckets;           //  non-empty while migrating
+    std::size_t migrated = 0;   //  old buckets already moved
+
+    std::uint64_t rehashes = 0;
+    std::chrono::nanoseconds rehashDuration{ 0 };
+
+    GroupAllocator allocator() const noexcept {
+        return buckets.groups.get_allocator();
+    }
+
+    /**
+     * Spread the user hash over all bits, so that power-of-two masking does
+     *     not only look at the lowest bits (std::hash is the identity for
+     *     integers)
+     */
+    static std::size_t mix(std::size_t hash) noexcept {
+        auto h = static_cast<std::uint64_t>(hash) * 0x9E3779B97F4A7C15ull;
+        return static_cast<std::size_t>(h ^ (h >> 32));
+    }
+
+    /**
+     * Control byte of a mixed hash: its lowest 7 bits, the rest choosing
+     *     the home group
+     */
+    static std::uint8_t tag(std::size_t h) noexcept {
+        return static_cast<std::uint8_t>(h & 0x7F);
+    }
+
+    static std::size_t homeGroup(std::size_t h, std::size_t tableMask) noexcept {
+        return (h >> 7) & tableMask & ~(ControlGroup::SIZE - 1);
+    }
+
+    static std::size_t nextGroup(std::size_t pos, std::size_t tableMask) noexcept {
+        return (pos + ControlGroup::SIZE) & tableMask;
+    }
+
+    std::size_t requiredBuckets(std::size_t size) const noexcept {
+        std::size_t count = MIN_BUCKETS;
+        while (size > count * maxLoadFactor)
+            count *= 2;
+
+        return count;
+    }
+
+    /**
+     * Bucket count to grow or clean up to with size live slots.  It leaves
+     *     room for half as many slots again, so that neither tombstone
+     *     clean-ups nor migrations follow each other closely, but is never
+     *     more than what a full index (limit slots) needs.
+     */
+    std::size_t targetBuckets(std::size_t size) const noexcept {
+        auto bounded = std::min(size, limit);
+        return requiredBuckets(std::max(size, bounded + bounded / 2));
+    }
+
+    template <class TMatch>
+    static std::uint32_t probe(const Table & table, std::size_t hash, TMatch & match) {
+        if (table.empty())
+            return NONE;
+
+        auto h = mix(hash);
+        auto pos = homeGroup(h, table.mask);
+
+        //  the slots of a group mostly lie in the cache line after its
+        //  control bytes: load both at once
+        prefetchRead(&table.slot(pos + ControlGroup::SIZE - 1));
+
+        for (; ; pos = nextGroup(pos, table.mask)) {
+            ControlGroup group(table.controls(pos));
+            for (auto matches = group.match(tag(h)); matches != 0; matches &= matches - 1) {
+                auto slot = table.slot(pos + ControlGroup::lowestBit(matches));
+                if (match(slot))
+                    return slot;
+            }
+
+            if (group.matchEmpty() != 0)
+                return NONE;
+        }
+    }
+
+    static bool remove(Table & table, std::size_t hash, std::uint32_t slot) noexcept {
+        if (table.empty())
+            return false;
+
+        auto h = mix(hash);
+        for (auto pos = homeGroup(h, table.mask); ; pos = nextGroup(pos, table.mask)) {
+            ControlGroup group(table.controls(pos));
+            for (auto matches = group.match(tag(h)); matches != 0; matches &= matches - 1) {
+                auto i = pos + ControlGroup::lowestBit(matches);
+                if (table.slot(i) != slot)
+                    continue;
+
+                //  empty buckets are never made again but by a rehash, so a
+                //  group with one has never been full and no probe went on
+                //  past it
+                if (group.matchEmpty() != 0) {
+                    table.control(i) = ControlGroup::EMPTY;
+                    --table.occupied;
+                } else {
+                    table.control(i) = ControlGroup::DELETED;
+                }
+
+                return true;
+            }
+
+            if (group.matchEmpty() != 0)
+                return false;
+        }
+    }
+
+    void place(std::size_t hash, std::uint32_t slot) noexcept {
+        auto h = mix(hash);
+        auto pos = homeGroup(h, buckets.mask);
+
+        std::uint32_t free;
+        while ((free = ControlGroup(buckets.controls(pos)).matchFree()) == 0)
+            pos = nextGroup(pos, buckets.mask);
+
+        pos += ControlGroup::lowestBit(free);
+        if (buckets.control(pos) == ControlGroup::EMPTY)
+            ++buckets.occupied;
+
+        buckets.control(pos) = tag(h);
+        buckets.slot(pos) = slot;
+    }
+
+    template <class THashOf>
+    void rehash(std::size_t count, THashOf && hashOf) {
+        auto start = std::chrono::steady_clock::now();
+
+        auto previous = std::exchange(buckets, Table(count, allocator()));
+        for (std::size_t pos = 0; pos < previous.size(); pos += ControlGroup::SIZE) {
+            //  hash the slots of a group before placing any, so that the
+            //  reads of their keys overlap
+            std::uint32_t slots[ControlGroup::SIZE];
+            std::size_t hashes[ControlGroup::SIZE];
+            std::size_t n = 0;
+            auto full = ~ControlGroup(previous.controls(pos)).matchFree() & 0xFFFF;
+            for (; full != 0; full &= full - 1) {
+                slots[n] = previous.slot(pos + ControlGroup::lowestBit(full));
+                hashes[n] = hashOf(slots[n]);
+                ++n;
+            }
+
+            for (std::size_t i = 0; i < n; ++i) {
+                place(hashes[i], slots[i]);
+            }
+        }
+
+        ++rehashes;
+        rehashDuration += std::chrono::steady_clock::now() - start;
+    }
+
+    void startMigration(std::size_t count) {
+        ++rehashes;
+
+        oldBuckets = std::exchange(buckets, Table(count, allocator()));
+        migrated = 0;
+    }
+
+    /**
+     * Move up to limit old buckets into the new array.  A moved bucket is
+     *     marked deleted rather than empty so that probe sequences of the old
+     *     buckets not moved yet are not cut.
+     */
+    template <class THashOf>
+    void migrate(std::size_t limit, THashOf & hashOf) {
+        auto last = std::min(oldBuckets.size(), migrated + limit);
+        for (; migrated < last; ++migrated) {
+            if (oldBuckets.control(migrated) >= ControlGroup::EMPTY)
+                continue;
+
+            oldBuckets.control(migrated) = ControlGroup::DELETED;
+            place(hashOf(oldBuckets.slot(migrated)), oldBuckets.slot(migrated));
+        }
+
+        if (migrated == oldBuckets.size())
+            dropMigration();
+    }
+
+    template <class THashOf>
+    static std::uint64_t probeCount(const Table & table, THashOf & hashOf) {
+        std::uint64_t count = 0;
+        for (std::size_t pos = 0; pos < table.size(); ++pos) {
+            if (table.control(pos) >= ControlGroup::EMPTY)
+                continue;
+
+            auto home = homeGroup(mix(hashOf(table.slot(pos))), table.mask);
+            count += ((pos - home) & table.mask) / ControlGroup::SIZE + 1;
+        }
+
+        return count;
+    }
+
+    void dropMigration() noexcept {
+        oldBuckets = Table(allocator());
+        migrated = 0;
+    }
+};
+
+using SlotIndex = BasicSlotIndex<>;
+
+#endif //LRU_SLOTINDEX_H
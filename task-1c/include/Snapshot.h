@@ -0,0 +1,265 @@
+#ifndef LRU_SNAPSHOT_H
+#define LRU_SNAPSHOT_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LRU_SNAPSHOT_MMAP 1
+#endif
+
+/**
+ * Layout of a snapshot file: this header, then the entries from the least to
+ *     the most recently used, each a key and a value as their serializers
+ *     wrote them.  Numbers are in the byte order of the machine, which the
+ *     header records, so a snapshot only loads where it was saved.
+ */
+struct SnapshotHeader final {
+    static constexpr const char MAGIC[8] = { 'L', 'R', 'U', 'S', 'N', 'A', 'P', '\0' };
+    static constexpr const std::uint32_t VERSION = 1;
+    static constexpr const std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrder;
+    std::uint64_t count;    //  number of entries
+};
+
+/**
+ * Buffered writer of a snapshot file
+ */
+class SnapshotWriter final {
+public:
+    /**
+     * Create or truncate a file
+     * @param path path of the file
+     */
+    explicit SnapshotWriter(const std::string & path)
+            : path(path), file(std::fopen(path.c_str(), "wb")) {
+        if (!file)
+            throw std::system_error(errno, std::generic_category(), "cannot create " + path);
+
+        buffer.reserve(BUFFER_SIZE);
+    }
+
+    SnapshotWriter(const SnapshotWriter &) = delete;
+    SnapshotWriter & operator=(const SnapshotWriter &) = delete;
+
+    ~SnapshotWriter() {
+        if (file)
+            std::fclose(file);
+    }
+
+    void write(const void * data, std::size_t size) {
+        if (buffer.size() + size > BUFFER_SIZE)
+            flush();
+
+        if (size > BUFFER_SIZE) {
+            put(data, size);
+            return;
+        }
+
+        auto bytes = static_cast<const char *>(data);
+        buffer.insert(buffer.end(), bytes, bytes + size);
+    }
+
+    /**
+     * Flush and close the file, reporting the errors the destructor would
+     *     ignore
+     */
+    void close() {
+        flush();
+
+        auto result = std::fclose(std::exchange(file, nullptr));
+        if (result != 0)
+            throw std::system_error(errno, std::generic_category(), "cannot write " + path);
+    }
+
+private:
+    static constexpr const std::size_t BUFFER_SIZE = 1 << 20;
+
+    std::string path;
+    std::FILE * file;
+    std::vector<char> buffer;
+
+    void flush() {
+        put(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+
+    void put(const void * data, std::size_t size) {
+        if (size == 0)
+            return;
+
+        if (std::fwrite(data, 1, size, file) != size)
+            throw std::system_error(errno, std::generic_category(), "cannot write " + path);
+    }
+};
+
+/**
+ * Reader of the bytes of a snapshot, in memory
+ */
+class SnapshotReader final {
+public:
+    SnapshotReader(const char * data, std::size_t size) noexcept
+            : cursor(data), end(data + size) {
+    }
+
+    void read(void * data, std::size_t size) {
+        //  an empty container may give a null pointer, which memcpy must not get
+        if (size != 0)
+            std::memcpy(data, take(size), size);
+    }
+
+    /**
+     * Consume bytes without copying them
+     * @param size number of bytes
+     * @return the address of the bytes, valid as long as the snapshot
+     */
+    const char * take(std::size_t size) {
+        if (size > static_cast<std::size_t>(end - cursor))
+            throw std::runtime_error("snapshot is truncated");
+
+        auto result = cursor;
+        cursor += size;
+        return result;
+    }
+
+    bool atEnd() const noexcept {
+        return cursor == end;
+    }
+
+private:
+    const char * cursor;
+    const char * end;
+};
+
+/**
+ * Read-only file mapped in memory, read whole where mmap() does not exist
+ */
+class MappedFile final {
+public:
+    explicit MappedFile(const std::string & path) {
+#ifdef LRU_SNAPSHOT_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), "cannot open " + path);
+
+        struct stat status;
+        if (::fstat(fd, &status) != 0) {
+            auto error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), "cannot stat " + path);
+        }
+
+        length = static_cast<std::size_t>(status.st_size);
+        if (length > 0) {
+            auto address = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (address == MAP_FAILED) {
+                auto error = errno;
+                ::close(fd);
+                throw std::system_error(error, std::generic_category(), "cannot map " + path);
+            }
+
+            //  read ahead aggressively: the file is parsed once, front to back
+            ::madvise(address, length, MADV_SEQUENTIAL);
+            mapping = static_cast<const char *>(address);
+        }
+
+        ::close(fd);
+#else
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+            throw std::system_error(errno, std::generic_category(), "cannot open " + path);
+
+        contents.resize(static_cast<std::size_t>(file.tellg()));
+        file.seekg(0);
+        if (!file.read(contents.data(), static_cast<std::streamsize>(contents.size())))
+            throw std::system_error(errno, std::generic_category(), "cannot read " + path);
+
+        mapping = contents.data();
+        length = contents.size();
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+#ifdef LRU_SNAPSHOT_MMAP
+        if (mapping)
+            ::munmap(const_cast<char *>(mapping), length);
+#endif
+    }
+
+    const char * data() const noexcept {
+        return mapping;
+    }
+
+    std::size_t size() const noexcept {
+        return length;
+    }
+
+private:
+    const char * mapping = nullptr;
+    std::size_t length = 0;
+#ifndef LRU_SNAPSHOT_MMAP
+    std::vector<char> contents;
+#endif
+};
+
+/**
+ * Default serializer of the keys and values of a snapshot, defined for
+ *     trivially copyable types, copied as they are, and std::string.
+ *     Specialize it, or pass other serializers to saveSnapshot() and
+ *     loadSnapshot(), for other types: a serializer has
+ *     static void write(SnapshotWriter &, const T &) and
+ *     static T read(SnapshotReader &).
+ */
+template <class T, class = void>
+struct Serializer;
+
+template <class T>
+struct Serializer<T, std::enable_if_t<std::is_trivially_copyable<T>::value>> final {
+    static void write(SnapshotWriter & out, const T & value) {
+        out.write(&value, sizeof(T));
+    }
+
+    static T read(SnapshotReader & in) {
+        T value;
+        in.read(&value, sizeof(T));
+        return value;
+    }
+};
+
+template <>
+struct Serializer<std::string> final {
+    static void write(SnapshotWriter & out, const std::string & value) {
+        std::uint64_t size = value.size();
+        out.write(&size, sizeof(size));
+        out.write(value.data(), value.size());
+    }
+
+    static std::string read(SnapshotReader & in) {
+        std::uint64_t size;
+        in.read(&size, sizeof(size));
+
+        auto n = static_cast<std::size_t>(size);
+        return std::string(in.take(n), n);
+    }
+};
+
+#endif //LRU_SNAPSHOT_H
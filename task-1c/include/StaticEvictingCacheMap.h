@@ -0,0 +1,647 @@
+#ifndef LRU_STATICEVICTINGCACHEMAP_H
+#define LRU_STATICEVICTINGCACHEMAP_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+/**
+ * Storage of one entry, left unconstructed until the entry is put.  It has
+ *     a destructor, which does nothing, only when T needs one.
+ */
+template <class T, bool = std::is_trivially_destructible<T>::value>
+union StaticEntry {
+    constexpr StaticEntry() noexcept
+            : none() {
+    }
+
+    char none;
+    T value;
+};
+
+template <class T>
+union StaticEntry<T, false> {
+    constexpr StaticEntry() noexcept
+            : none() {
+    }
+
+    ~StaticEntry() {
+    }
+
+    char none;
+    T value;
+};
+
+/**
+ * The entries of a StaticEvictingCacheMap and their recency list.  Links are
+ *     1-based slot numbers, 0 ending the list, so that the empty list is all
+ *     zeroes.
+ */
+template <class T, class TIndex, std::size_t N>
+struct StaticSlotList {
+    struct Slot {
+        StaticEntry<T> entry;
+        TIndex prev = 0;
+        TIndex next = 0;
+    };
+
+    std::array<Slot, N> slots{};
+    TIndex head = 0;
+    TIndex tail = 0;
+
+    constexpr Slot & at(TIndex i) noexcept {
+        return slots[i - 1];
+    }
+
+    constexpr const Slot & at(TIndex i) const noexcept {
+        return slots[i - 1];
+    }
+
+    void destroy() noexcept {
+        if constexpr (!std::is_trivially_destructible<T>::value) {
+            for (auto i = head; i != 0; i = at(i).next) {
+                at(i).entry.value.~T();
+            }
+        }
+    }
+};
+
+//  the destructor of the entries, for those which need one
+template <class T, class TIndex, std::size_t N, bool = std::is_trivially_destructible<T>::value>
+struct StaticSlots : StaticSlotList<T, TIndex, N> {
+};
+
+template <class T, class TIndex, std::size_t N>
+struct StaticSlots<T, TIndex, N, false> : StaticSlotList<T, TIndex, N> {
+    constexpr StaticSlots() = default;
+
+    StaticSlots(const StaticSlots &) = delete;
+    StaticSlots & operator=(const StaticSlots &) = delete;
+
+    ~StaticSlots() {
+        this->destroy();
+    }
+};
+
+/**
+ * LRU map of at most N entries, with all its storage inline: it never
+ *     allocates, and creating one costs no more than zeroing it.  The
+ *     default constructor is constexpr, so static and thread_local maps are
+ *     initialized at compile time, and with trivially destructible keys and
+ *     values the map is a literal type.  Meant for many small caches, e.g.
+ *     per connection or per thread memoization, with N from a few entries to
+ *     a few hundred; EvictingCacheMap remains the map for large caches.
+ *
+ * Entries live in an array of N slots, in a doubly linked recency list by
+ *     8-bit slot numbers up to 254 slots, 16-bit ones above.  Up to
+ *     LINEAR_SEARCH_MAX entries, the keys of the slots are compared one by
+ *     one, in array order rather than down the list so that the loads do not
+ *     wait on each other, and THash is never called; above it, keys are found
+ *     through an inline open-addressing index of at least 2 N buckets, with
+ *     linear probing and backward-shift deletion, and every slot keeps the
+ *     hash of its key.
+ *
+ * The semantics are those of EvictingCacheMap with LruPolicy: get() and
+ *     find() promote, a put() into a full map evicts the least recently used
+ *     entry, iteration goes from the most to the least recently used entry.
+ *     There are no weights, TTLs, removal listeners nor stats.  Iterators
+ *     stay valid until their entry is erased or evicted.
+ */
+template <class TKey, class TValue, std::size_t N, class THash = std::hash<TKey>>
+class StaticEvictingCacheMap final {
+public:
+    using key_type = TKey;
+    using mapped_type = TValue;
+    using value_type = std::pair<const TKey, TValue>;
+
+    static constexpr const std::size_t LINEAR_SEARCH_MAX = 8;
+    static constexpr const bool HASHED = N > LINEAR_SEARCH_MAX;
+
+private:
+    static_assert(N > 0 && N < UINT16_MAX, "StaticEvictingCacheMap holds 1 to 65534 entries");
+
+    using Index = std::conditional_t<(N < UINT8_MAX), std::uint8_t, std::uint16_t>;
+    using Slots = StaticSlots<value_type, Index, N>;
+
+    static constexpr std::size_t bucketBits() noexcept {
+        std::size_t bits = 1;
+        while ((std::size_t(1) << bits) < 2 * N) {
+            ++bits;
+        }
+
+        return bits;
+    }
+
+    static constexpr const std::size_t BUCKET_BITS = bucketBits();
+    static constexpr const std::size_t BUCKETS = HASHED ? std::size_t(1) << BUCKET_BITS : 0;
+    static constexpr const std::size_t MASK = BUCKETS - 1;
+
+    template <bool IS_CONST>
+    class Iterator final {
+        using map_pointer = std::conditional_t<IS_CONST,
+                const StaticEvictingCacheMap *, StaticEvictingCacheMap *>;
+
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = StaticEvictingCacheMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<IS_CONST, const value_type *, value_type *>;
+        using reference = std::conditional_t<IS_CONST, const value_type &, value_type &>;
+
+        Iterator() noexcept = default;
+
+        template <bool OTHER_CONST, class = std::enable_if_t<IS_CONST && !OTHER_CONST>>
+        Iterator(const Iterator<OTHER_CONST> & other) noexcept
+                : map(other.map), slot(other.slot) {
+        }
+
+        reference operator*() const {
+            return map->slots.at(slot).entry.value;
+        }
+
+        pointer operator->() const {
+            return &map->slots.at(slot).entry.value;
+        }
+
+        Iterator & operator++() {
+            slot = map->slots.at(slot).next;
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            auto tmp = *this;
+            ++*this;
+            return tmp;
+        }
+
+        Iterator & operator--() {
+            slot = (slot == 0) ? map->slots.tail : map->slots.at(slot).prev;
+            return *this;
+        }
+
+        Iterator operator--(int) {
+            auto tmp = *this;
+            --*this;
+            return tmp;
+        }
+
+        friend bool operator==(const Iterator & a, const Iterator & b) noexcept {
+            return a.map == b.map && a.slot == b.slot;
+        }
+
+        friend bool operator!=(const Iterator & a, const Iterator & b) noexcept {
+            return !(a == b);
+        }
+
+    private:
+        map_pointer map = nullptr;
+        Index slot = 0;
+
+        Iterator(map_pointer map, Index slot) noexcept
+                : map(map), slot(slot) {
+        }
+
+        friend class Iterator<!IS_CONST>;
+        friend class StaticEvictingCacheMap;
+    };
+
+public:
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    constexpr StaticEvictingCacheMap() = default;
+
+    /**
+     * Construct a StaticEvictingCacheMap
+     * @param hash hash function for the keys, used above LINEAR_SEARCH_MAX
+     *     entries only
+     */
+    constexpr explicit StaticEvictingCacheMap(const THash & hash)
+            : hasher(hash) {
+    }
+
+    StaticEvictingCacheMap(const StaticEvictingCacheMap & other)
+            : hasher(other.hasher) {
+        putAll(other);
+    }
+
+    StaticEvictingCacheMap(StaticEvictingCacheMap && other)
+            : hasher(other.hasher) {
+        putAll(std::move(other));
+    }
+
+    StaticEvictingCacheMap & operator=(const StaticEvictingCacheMap & other) {
+        if (this != &other) {
+            clear();
+            hasher = other.hasher;
+            putAll(other);
+        }
+
+        return *this;
+    }
+
+    /**
+     * Move the entries of another map, which is left empty.  Keys are
+     *     copied, since they are const in the entries; values are moved.
+     */
+    StaticEvictingCacheMap & operator=(StaticEvictingCacheMap && other) {
+        if (this != &other) {
+            clear();
+            hasher = other.hasher;
+            putAll(std::move(other));
+        }
+
+        return *this;
+    }
+
+    /**
+     * Check for existence of a specific key in the map.  This operation has
+     *     no effect on LRU order.
+     * @param key key to search for
+     * @return true if exists, false otherwise
+     */
+    bool exists(const TKey & key) const {
+        return lookup(key, hashKey(key)) != 0;
+    }
+
+    /**
+     * Get the value associated with a specific key, promoting it to the head
+     *     of the LRU
+     * @param key key associated with the value
+     * @return the value if it exists
+     */
+    std::optional<TValue> get(const TKey & key) {
+        auto it = find(key);
+        if (it == end())
+            return {};
+
+        return it->second;
+    }
+
+    /**
+     * Get the iterator associated with a specific key, promoting it to the
+     *     head of the LRU
+     * @param key key to associate with value
+     * @return the iterator of the entry or end() if it does not exist
+     */
+    iterator find(const TKey & key) {
+        auto slot = lookup(key, hashKey(key));
+        if (slot != 0)
+            moveToFront(slot);
+
+        return iterator(this, slot);
+    }
+
+    /**
+     * Get the iterator associated with a specific key without promoting it
+     * @param key key to search for
+     * @return the iterator of the entry or end() if it does not exist
+     */
+    const_iterator find(const TKey & key) const {
+        return const_iterator(this, lookup(key, hashKey(key)));
+    }
+
+    /**
+     * Get a pointer to the value associated with a key without promoting it
+     * @param key key associated with the value
+     * @return a pointer to the value, or nullptr if it does not exist
+     */
+    TValue * peek(const TKey & key) {
+        auto slot = lookup(key, hashKey(key));
+        return (slot == 0) ? nullptr : &slots.at(slot).entry.value.second;
+    }
+
+    const TValue * peek(const TKey & key) const {
+        auto slot = lookup(key, hashKey(key));
+        return (slot == 0) ? nullptr : &slots.at(slot).entry.value.second;
+    }
+
+    /**
+     * Erase the key-value pair associated with key if it exists.
+     * @param key key associated with the value
+     * @return true if the key existed and was erased, else false
+     */
+    bool erase(const TKey & key) {
+        auto slot = lookup(key, hashKey(key));
+        if (slot == 0)
+            return false;
+
+        unindex(slot);
+        unlink(slot);
+        slots.at(slot).entry.value.~value_type();
+        pushFree(slot);
+        return true;
+    }
+
+    /**
+     * Set a key-value pair in the dictionary, evicting the least recently
+     *     used entry if the map is full and the key is new
+     * @param key key to associate with value
+     * @param value value to associate with the key
+     */
+    template <class T, class E>
+    void put(T && key, E && value) {
+        const TKey & k = key;
+        auto h = hashKey(k);
+
+        auto slot = lookup(k, h);
+        if (slot != 0) {
+            slots.at(slot).entry.value.second = std::forward<E>(value);
+            moveToFront(slot);
+            return;
+        }
+
+        insert(h, std::forward<T>(key), std::forward<E>(value));
+    }
+
+    /**
+     * Associate a value built in place from args with a key, unless the key
+     *     already exists: then nothing is built nor replaced, and the entry
+     *     is promoted as find() would
+     * @param key key to associate with the value
+     * @param args arguments of the TValue constructor
+     * @return the iterator of the entry of the key, and whether the value
+     *     was built
+     */
+    template <class T, class... Args>
+    std::pair<iterator, bool> try_emplace(T && key, Args &&... args) {
+        const TKey & k = key;
+        auto h = hashKey(k);
+
+        auto slot = lookup(k, h);
+        if (slot != 0) {
+            moveToFront(slot);
+            return { iterator(this, slot), false };
+        }
+
+        slot = insert(h, std::piecewise_construct,
+                      std::forward_as_tuple(std::forward<T>(key)),
+                      std::forward_as_tuple(std::forward<Args>(args)...));
+        return { iterator(this, slot), true };
+    }
+
+    constexpr std::size_t size() const noexcept {
+        return count;
+    }
+
+    constexpr bool empty() const noexcept {
+        return count == 0;
+    }
+
+    static constexpr std::size_t capacity() noexcept {
+        return N;
+    }
+
+    /**
+     * Erase all the entries
+     */
+    void clear() noexcept {
+        slots.destroy();
+        slots.head = 0;
+        slots.tail = 0;
+        count = 0;
+        used = 0;
+        freeHead = 0;
+        live = 0;
+        buckets.fill(0);
+    }
+
+    iterator begin() noexcept {
+        return iterator(this, slots.head);
+    }
+
+    iterator end() noexcept {
+        return iterator(this, 0);
+    }
+
+    const_iterator begin() const noexcept {
+        return const_iterator(this, slots.head);
+    }
+
+    const_iterator end() const noexcept {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator cbegin() const noexcept {
+        return begin();
+    }
+
+    const_iterator cend() const noexcept {
+        return end();
+    }
+
+    std::reverse_iterator<iterator> rbegin() noexcept {
+        return std::reverse_iterator<iterator>(end());
+    }
+
+    std::reverse_iterator<iterator> rend() noexcept {
+        return std::reverse_iterator<iterator>(begin());
+    }
+
+    std::reverse_iterator<const_iterator> rbegin() const noexcept {
+        return std::reverse_iterator<const_iterator>(end());
+    }
+
+    std::reverse_iterator<const_iterator> rend() const noexcept {
+        return std::reverse_iterator<const_iterator>(begin());
+    }
+
+private:
+    Slots slots;
+    Index count = 0;
+    Index used = 0;         //  slots ever used, the others are free
+    Index freeHead = 0;     //  slots freed by erase(), linked by next
+    std::uint32_t live = 0; //  bit per slot holding an entry, without an index
+
+    std::array<Index, BUCKETS> buckets{};           //  1-based slots, 0 for empty
+    std::array<std::size_t, HASHED ? N : 0> hashes{};   //  key hashes by slot
+
+    THash hasher;
+
+    std::size_t hashKey(const TKey & key) const {
+        if constexpr (HASHED) {
+            return hasher(key);
+        } else {
+            return 0;
+        }
+    }
+
+    /**
+     * Fibonacci hashing, so that identity hashes spread over the buckets
+     */
+    static std::size_t bucketOf(std::size_t h) noexcept {
+        return static_cast<std::size_t>((static_cast<std::uint64_t>(h) * 0x9E3779B97F4A7C15ull)
+                                        >> (64 - BUCKET_BITS));
+    }
+
+    /**
+     * Find the slot of a key
+     * @param h hash of the key, unused without an index
+     * @return the slot or 0
+     */
+    Index lookup(const TKey & key, std::size_t h) const {
+        if constexpr (HASHED) {
+            for (auto pos = bucketOf(h); buckets[pos] != 0; pos = (pos + 1) & MASK) {
+                auto slot = buckets[pos];
+                if (hashes[slot - 1] == h && slots.at(slot).entry.value.first == key)
+                    return slot;
+            }
+        } else {
+            for (Index slot = 1; slot <= used; ++slot) {
+                if ((live >> (slot - 1) & 1) != 0 && slots.at(slot).entry.value.first == key)
+                    return slot;
+            }
+        }
+
+        return 0;
+    }
+
+    void index(Index slot, std::size_t h) noexcept {
+        if constexpr (!HASHED) {
+            live |= std::uint32_t(1) << (slot - 1);
+        } else {
+            hashes[slot - 1] = h;
+
+            auto pos = bucketOf(h);
+            while (buckets[pos] != 0) {
+                pos = (pos + 1) & MASK;
+            }
+            buckets[pos] = slot;
+        }
+    }
+
+    /**
+     * Remove a slot from the index, or clear its live bit without one.  Keys
+     *     which follow it in their probe sequences are shifted back instead
+     *     of leaving a tombstone.
+     */
+    void unindex(Index slot) noexcept {
+        if constexpr (!HASHED) {
+            live &= ~(std::uint32_t(1) << (slot - 1));
+        } else {
+            auto hole = bucketOf(hashes[slot - 1]);
+            while (buckets[hole] != slot) {
+                hole = (hole + 1) & MASK;
+            }
+
+            for (auto pos = (hole + 1) & MASK; buckets[pos] != 0; pos = (pos + 1) & MASK) {
+                auto home = bucketOf(hashes[buckets[pos] - 1]);
+                if (((pos - home) & MASK) >= ((pos - hole) & MASK)) {
+                    buckets[hole] = buckets[pos];
+                    hole = pos;
+                }
+            }
+            buckets[hole] = 0;
+        }
+    }
+
+    void pushFront(Index slot) noexcept {
+        auto & s = slots.at(slot);
+        s.prev = 0;
+        s.next = slots.head;
+
+        if (slots.head != 0)
+            slots.at(slots.head).prev = slot;
+        else
+            slots.tail = slot;
+
+        slots.head = slot;
+        ++count;
+    }
+
+    void unlink(Index slot) noexcept {
+        auto & s = slots.at(slot);
+        if (s.prev != 0)
+            slots.at(s.prev).next = s.next;
+        else
+            slots.head = s.next;
+
+        if (s.next != 0)
+            slots.at(s.next).prev = s.prev;
+        else
+            slots.tail = s.prev;
+
+        --count;
+    }
+
+    void moveToFront(Index slot) noexcept {
+        if (slot != slots.head) {
+            unlink(slot);
+            pushFront(slot);
+        }
+    }
+
+    void pushFree(Index slot) noexcept {
+        slots.at(slot).next = freeHead;
+        freeHead = slot;
+    }
+
+    /**
+     * Get a slot for a new entry: a free one, or that of the least recently
+     *     used entry, evicted
+     */
+    Index acquire() noexcept {
+        if (count == N) {
+            auto slot = slots.tail;
+            unindex(slot);
+            unlink(slot);
+            slots.at(slot).entry.value.~value_type();
+            return slot;
+        }
+
+        if (freeHead != 0) {
+            auto slot = freeHead;
+            freeHead = slots.at(slot).next;
+            return slot;
+        }
+
+        return ++used;
+    }
+
+    /**
+     * Add an entry whose key is known to be absent
+     * @param h hash of the key
+     * @param args arguments of the value_type constructor
+     * @return the slot of the entry
+     */
+    template <class... Args>
+    Index insert(std::size_t h, Args &&... args) {
+        auto slot = acquire();
+        try {
+            new (&slots.at(slot).entry.value) value_type(std::forward<Args>(args)...);
+        } catch (...) {
+            pushFree(slot);
+            throw;
+        }
+
+        pushFront(slot);
+        index(slot, h);
+        return slot;
+    }
+
+    /**
+     * Put the entries of another map, from its least recently used one, so
+     *     that the recency order is kept
+     */
+    void putAll(const StaticEvictingCacheMap & other) {
+        for (auto it = other.rbegin(); it != other.rend(); ++it) {
+            insert(hashKey(it->first), it->first, it->second);
+        }
+    }
+
+    void putAll(StaticEvictingCacheMap && other) {
+        for (auto it = other.rbegin(); it != other.rend(); ++it) {
+            insert(hashKey(it->first), it->first, std::move(it->second));
+        }
+
+        other.clear();
+    }
+};
+
+#endif //LRU_STATICEVICTINGCACHEMAP_H
@@ -0,0 +1,112 @@
+#ifndef LRU_THREADPOOL_H
+#define LRU_THREADPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * Fixed set of threads running tasks in the order they were submitted, to
+ *     back the executor of an AsyncLoadingCache.  Destroying the pool runs
+ *     the tasks still queued, then joins the threads.
+ */
+class ThreadPool final {
+public:
+    /**
+     * Start the threads
+     * @param threadCount number of threads, at least one
+     */
+    explicit ThreadPool(std::size_t threadCount) {
+        if (threadCount == 0)
+            throw std::invalid_argument("ThreadPool needs at least one thread");
+
+        threads.reserve(threadCount);
+        try {
+            for (std::size_t i = 0; i < threadCount; ++i) {
+                threads.emplace_back([this] {
+                    run();
+                });
+            }
+        } catch (...) {
+            //  joinable threads would terminate the program when destroyed
+            stop();
+            throw;
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool & operator=(const ThreadPool &) = delete;
+
+    ~ThreadPool() {
+        stop();
+    }
+
+    /**
+     * Queue a task for the next free thread.  As with std::thread, a task
+     *     which throws terminates the program.
+     * @param task function to run
+     */
+    void execute(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back(std::move(task));
+        }
+
+        ready.notify_one();
+    }
+
+    std::size_t threadCount() const noexcept {
+        return threads.size();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::function<void()>> tasks;
+    bool stopping = false;
+
+    std::vector<std::thread> threads;
+
+    /**
+     * Let the threads run the queued tasks, then join them
+     */
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+
+        ready.notify_all();
+        for (auto & thread : threads) {
+            thread.join();
+        }
+    }
+
+    void run() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [this] {
+                    return stopping || !tasks.empty();
+                });
+
+                if (tasks.empty())
+                    return;
+
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+
+            task();
+        }
+    }
+};
+
+#endif //LRU_THREADPOOL_H
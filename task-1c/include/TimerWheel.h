@@ -0,0 +1,285 @@
+#ifndef LRU_TIMERWHEEL_H
+#define LRU_TIMERWHEEL_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+/**
+ * Hierarchical timer wheel over 32-bit slot numbers, with times in
+ *     nanoseconds.  Each level is a ring of buckets covering a span of time
+ *     64 (or 32, 4) times longer than the level below it: a timer goes to the
+ *     finest level whose ring spans the time it has left, and moves down a
+ *     level when the wheel reaches its bucket before it is due.
+ *
+ * Scheduling and cancelling are O(1), and advancing costs O(1) per timer per
+ *     level on top of the buckets passed, so the cost of expiring an entry is
+ *     amortized O(1).  Level 0 buckets last 2^30 ns (about a second): a timer
+ *     fires at most that late, so callers needing exact expiry compare the
+ *     expiry() of a slot with the current time as well.
+ *
+ * Timers are doubly linked through per-slot arrays, in circular lists with a
+ *     sentinel per bucket; the sentinels take the first array entries.  The
+ *     arrays come from TAllocator, rebound.
+ */
+template <class TAllocator = std::allocator<std::uint64_t>>
+class BasicTimerWheel final {
+    using AllocatorTraits = std::allocator_traits<TAllocator>;
+    using LinkVector = std::vector<std::uint32_t,
+            typename AllocatorTraits::template rebind_alloc<std::uint32_t>>;
+    using TimeVector = std::vector<std::uint64_t,
+            typename AllocatorTraits::template rebind_alloc<std::uint64_t>>;
+
+public:
+    static constexpr const std::uint64_t NEVER = UINT64_MAX;
+
+    BasicTimerWheel() = default;
+
+    explicit BasicTimerWheel(const TAllocator & allocator)
+            : prev(typename LinkVector::allocator_type(allocator)),
+              next(typename LinkVector::allocator_type(allocator)),
+              expiries(typename TimeVector::allocator_type(allocator)) {
+    }
+
+    /**
+     * Start the wheel for a number of slots, none of them scheduled
+     * @param size number of slots
+     * @param now current time
+     */
+    void start(std::size_t size, std::uint64_t now) {
+        if (!started()) {
+            for (std::uint32_t i = 0; i < SENTINELS; ++i) {
+                prev.push_back(i);
+                next.push_back(i);
+                expiries.push_back(NEVER);
+            }
+        }
+
+        time = now;
+        resize(size);
+    }
+
+    bool started() const noexcept {
+        return !expiries.empty();
+    }
+
+    /**
+     * Make room for slots [0, size); new slots are not scheduled
+     * @param size number of slots
+     */
+    void resize(std::size_t size) {
+        prev.resize(SENTINELS + size, UNLINKED);
+        next.resize(SENTINELS + size, UNLINKED);
+        expiries.resize(SENTINELS + size, NEVER);
+    }
+
+    /**
+     * Set the expiry time of a slot, replacing its previous one
+     * @param slot slot number
+     * @param expiry time at which the slot expires, or NEVER
+     */
+    void schedule(std::uint32_t slot, std::uint64_t expiry) noexcept {
+        auto node = SENTINELS + slot;
+        unlink(node);
+
+        expiries[node] = expiry;
+        if (expiry != NEVER)
+            link(node);
+    }
+
+    void cancel(std::uint32_t slot) noexcept {
+        schedule(slot, NEVER);
+    }
+
+    std::uint64_t expiry(std::uint32_t slot) const noexcept {
+        return expiries[SENTINELS + slot];
+    }
+
+    bool expired(std::uint32_t slot, std::uint64_t now) const noexcept {
+        return expiries[SENTINELS + slot] <= now;
+    }
+
+    /**
+     * Move the wheel to a time, passing every slot found due to a callback.
+     *     The slot is unscheduled before the call, so the callback may free
+     *     it, but it must not schedule or cancel other slots.
+     * @param now current time; the wheel never goes back
+     * @param onExpired function called with each expired slot
+     */
+    template <class TExpire>
+    void advance(std::uint64_t now, TExpire && onExpired) {
+        if (now <= time)
+            return;
+
+        auto previous = time;
+        time = now;
+
+        for (unsigned level = 0; level < LEVELS; ++level) {
+            auto previousTicks = previous >> SHIFTS[level];
+            auto currentTicks = now >> SHIFTS[level];
+            if (currentTicks <= previousTicks)
+                break;
+
+            expire(level, previousTicks, currentTicks - previousTicks, onExpired);
+        }
+    }
+
+    /**
+     * Fire the due timers of the current level 0 bucket, which advance()
+     *     only empties once the wheel has moved past it.  With advance(), it
+     *     fires every timer due by the time of the wheel.
+     * @param onExpired function called with each expired slot, as for
+     *     advance()
+     */
+    template <class TExpire>
+    void sweep(TExpire && onExpired) {
+        auto sentinel = OFFSETS[0] + static_cast<std::uint32_t>((time >> SHIFTS[0]) & (BUCKETS[0] - 1));
+        drain(sentinel, onExpired);
+    }
+
+    /**
+     * Move the timers to new slot numbers and resize the wheel
+     * @param size new number of slots
+     * @param newSlotOf function returning the new number of a scheduled slot
+     */
+    template <class TRenumber>
+    void renumber(std::size_t size, TRenumber && newSlotOf) {
+        std::vector<std::uint64_t> moved(size, NEVER);
+        for (std::size_t node = SENTINELS; node < expiries.size(); ++node) {
+            if (expiries[node] != NEVER)
+                moved[newSlotOf(static_cast<std::uint32_t>(node - SENTINELS))] = expiries[node];
+        }
+
+        release();
+        start(size, time);
+
+        for (std::uint32_t slot = 0; slot < size; ++slot) {
+            schedule(slot, moved[slot]);
+        }
+    }
+
+    /**
+     * Unschedule every slot
+     */
+    void clear() noexcept {
+        for (std::size_t node = 0; node < expiries.size(); ++node) {
+            bool sentinel = node < SENTINELS;
+            prev[node] = sentinel ? static_cast<std::uint32_t>(node) : UNLINKED;
+            next[node] = sentinel ? static_cast<std::uint32_t>(node) : UNLINKED;
+            expiries[node] = NEVER;
+        }
+    }
+
+    /**
+     * Stop the wheel and release its arrays
+     */
+    void reset() noexcept {
+        release();
+        time = 0;
+    }
+
+private:
+    static constexpr const std::uint32_t UNLINKED = UINT32_MAX;
+
+    static constexpr const unsigned LEVELS = 5;
+    static constexpr const std::uint32_t BUCKETS[LEVELS] = { 64, 64, 32, 4, 1 };
+    static constexpr const unsigned SHIFTS[LEVELS] = { 30, 36, 42, 47, 49 };
+    static constexpr const std::uint32_t OFFSETS[LEVELS] = { 0, 64, 128, 160, 164 };
+    static constexpr const std::uint32_t SENTINELS = 165;
+
+    LinkVector prev;
+    LinkVector next;
+    TimeVector expiries;
+
+    std::uint64_t time = 0;
+
+    void release() noexcept {
+        LinkVector(prev.get_allocator()).swap(prev);
+        LinkVector(next.get_allocator()).swap(next);
+        TimeVector(expiries.get_allocator()).swap(expiries);
+    }
+
+    /**
+     * Sentinel of the bucket for an expiry time: the finest level whose ring
+     *     spans the time left
+     */
+    std::uint32_t bucketOf(std::uint64_t expiry) const noexcept {
+        auto left = (expiry > time) ? expiry - time : 0;
+
+        for (unsigned level = 0; level + 1 < LEVELS; ++level) {
+            if (left < (std::uint64_t(1) << SHIFTS[level + 1])) {
+                auto ticks = expiry >> SHIFTS[level];
+                return OFFSETS[level] + static_cast<std::uint32_t>(ticks & (BUCKETS[level] - 1));
+            }
+        }
+
+        return OFFSETS[LEVELS - 1];
+    }
+
+    void link(std::uint32_t node) noexcept {
+        auto sentinel = bucketOf(expiries[node]);
+        auto last = prev[sentinel];
+
+        prev[node] = last;
+        next[node] = sentinel;
+        next[last] = node;
+        prev[sentinel] = node;
+    }
+
+    void unlink(std::uint32_t node) noexcept {
+        if (prev[node] == UNLINKED)
+            return;
+
+        next[prev[node]] = next[node];
+        prev[next[node]] = prev[node];
+        prev[node] = UNLINKED;
+        next[node] = UNLINKED;
+    }
+
+    /**
+     * Empty the buckets of a level passed since the previous ticks, up to
+     *     the current one; timers not due yet go down to a finer level
+     */
+    template <class TExpire>
+    void expire(unsigned level, std::uint64_t previousTicks, std::uint64_t delta,
+                TExpire & onExpired) {
+        auto mask = BUCKETS[level] - 1;
+        auto steps = static_cast<std::uint32_t>(std::min<std::uint64_t>(delta + 1, BUCKETS[level]));
+        auto start = static_cast<std::uint32_t>(previousTicks & mask);
+
+        for (std::uint32_t i = start; i < start + steps; ++i) {
+            drain(OFFSETS[level] + (i & mask), onExpired);
+        }
+    }
+
+    /**
+     * Empty a bucket, firing the due timers and rescheduling the others
+     */
+    template <class TExpire>
+    void drain(std::uint32_t sentinel, TExpire & onExpired) {
+        auto node = next[sentinel];
+        next[sentinel] = sentinel;
+        prev[sentinel] = sentinel;
+
+        while (node != sentinel) {
+            auto following = next[node];
+            prev[node] = UNLINKED;
+            next[node] = UNLINKED;
+
+            if (expiries[node] <= time) {
+                expiries[node] = NEVER;
+                onExpired(node - SENTINELS);
+            } else {
+                link(node);
+            }
+
+            node = following;
+        }
+    }
+};
+
+using TimerWheel = BasicTimerWheel<>;
+
+#endif //LRU_TIMERWHEEL_H
@@ -0,0 +1,158 @@
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <AsyncLoadingCache.h>
+#include <ThreadPool.h>
+
+using std::chrono::seconds;
+
+//  loader blocked until the test opens the gate, counting its calls
+
+struct GatedLoader {
+    std::promise<void> gate;
+    std::shared_future<void> opened = gate.get_future().share();
+    std::atomic<int> loads{ 0 };
+
+    int operator()(int key) {
+        ++loads;
+        opened.wait();
+
+        if (key < 0)
+            throw std::runtime_error("no such key");
+
+        return key * 10;
+    }
+};
+
+static bool isReady(const std::shared_future<int> & future) {
+    return future.wait_for(seconds(0)) == std::future_status::ready;
+}
+
+TEST(AsyncLoadingCacheTest, MissDoesNotBlock) {
+    GatedLoader loader;
+    ThreadPool pool(2);
+    AsyncLoadingCache<int, int> cache(10, [&loader](int key) {
+        return loader(key);
+    }, [&pool](std::function<void()> task) {
+        pool.execute(std::move(task));
+    });
+
+    auto first = cache.get(1);
+    auto second = cache.get(1);
+    ASSERT_FALSE(isReady(first));
+    ASSERT_FALSE(cache.getIfPresent(1).has_value());
+    ASSERT_EQ(cache.size(), 1u);
+
+    loader.gate.set_value();
+    ASSERT_EQ(first.get(), 10);
+    ASSERT_EQ(second.get(), 10);
+    ASSERT_EQ(loader.loads, 1);
+
+    ASSERT_TRUE(isReady(cache.get(1)));
+    ASSERT_EQ(cache.getIfPresent(1).value(), 10);
+    ASSERT_EQ(loader.loads, 1);
+}
+
+TEST(AsyncLoadingCacheTest, FailedLoad) {
+    GatedLoader loader;
+    loader.gate.set_value();
+
+    ThreadPool pool(1);
+    AsyncLoadingCache<int, int> cache(10, [&loader](int key) {
+        return loader(key);
+    }, [&pool](std::function<void()> task) {
+        pool.execute(std::move(task));
+    });
+
+    auto future = cache.get(-1);
+    ASSERT_THROW(future.get(), std::runtime_error);
+    ASSERT_EQ(cache.size(), 0u);
+
+    //  not cached: loaded again
+    ASSERT_THROW(cache.get(-1).get(), std::runtime_error);
+    ASSERT_EQ(loader.loads, 2);
+}
+
+TEST(AsyncLoadingCacheTest, RefusedTask) {
+    AsyncLoadingCache<int, int> cache(10, [](int key) {
+        return key;
+    }, [](std::function<void()>) {
+        throw std::runtime_error("executor is shut down");
+    });
+
+    ASSERT_THROW(cache.get(1).get(), std::runtime_error);
+    ASSERT_EQ(cache.size(), 0u);
+}
+
+TEST(AsyncLoadingCacheTest, DroppedTask) {
+    std::vector<std::function<void()>> queue;
+    AsyncLoadingCache<int, int> cache(10, [](int key) {
+        return key * 10;
+    }, [&queue](std::function<void()> task) {
+        queue.push_back(std::move(task));
+    });
+
+    auto dropped = cache.get(1);
+    ASSERT_EQ(cache.size(), 1u);
+
+    //  a shut down executor destroys the tasks it did not run
+    queue.clear();
+    ASSERT_THROW(dropped.get(), std::future_error);
+    ASSERT_EQ(cache.size(), 0u);
+
+    //  not cached: loaded again
+    auto loading = cache.get(1);
+    ASSERT_FALSE(isReady(loading));
+    queue.front()();
+    ASSERT_EQ(loading.get(), 10);
+    ASSERT_EQ(cache.getIfPresent(1).value(), 10);
+}
+
+TEST(AsyncLoadingCacheTest, EvictAndReplace) {
+    GatedLoader loader;
+    ThreadPool pool(2);
+    AsyncLoadingCache<int, int> cache(2, [&loader](int key) {
+        return loader(key);
+    }, [&pool](std::function<void()> task) {
+        pool.execute(std::move(task));
+    });
+
+    auto loading = cache.get(1);
+    cache.put(2, 2);
+    cache.put(3, 3);                //  evict the load of 1
+    ASSERT_EQ(cache.size(), 2u);
+
+    cache.put(1, 100);              //  a later entry the load must not touch
+    loader.gate.set_value();
+    ASSERT_EQ(loading.get(), 10);
+    ASSERT_EQ(cache.getIfPresent(1).value(), 100);
+    ASSERT_FALSE(cache.getIfPresent(2).has_value());
+
+    ASSERT_TRUE(cache.erase(1));
+    ASSERT_FALSE(cache.erase(1));
+}
+
+TEST(AsyncLoadingCacheTest, OutlivedByLoads) {
+    GatedLoader loader;
+    ThreadPool pool(1);
+    std::shared_future<int> future;
+
+    {
+        AsyncLoadingCache<int, int> cache(10, [&loader](int key) {
+            return loader(key);
+        }, [&pool](std::function<void()> task) {
+            pool.execute(std::move(task));
+        });
+
+        future = cache.get(4);
+    }
+
+    loader.gate.set_value();
+    ASSERT_EQ(future.get(), 40);
+}
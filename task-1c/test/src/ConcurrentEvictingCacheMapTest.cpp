@@ -0,0 +1,413 @@
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <ConcurrentEvictingCacheMap.h>
+
+using std::size_t;
+using std::thread;
+using std::vector;
+
+TEST(ConcurrentEvictingCacheMapTest, PutGet) {
+    auto map = ConcurrentEvictingCacheMap<int, int>(64, 4);
+    ASSERT_EQ(map.shardCount(), 4u);
+    ASSERT_EQ(map.getShardCapacity(), 16u);
+
+    map.put(1, 2);
+    map.put(3, 4);
+
+    ASSERT_EQ(map.get(1).value(), 2);
+    ASSERT_EQ(map.get(3).value(), 4);
+    ASSERT_FALSE(map.get(5).has_value());
+    ASSERT_TRUE(map.exists(1));
+    ASSERT_EQ(map.size(), 2u);
+
+    ASSERT_TRUE(map.erase(1));
+    ASSERT_FALSE(map.erase(1));
+    ASSERT_FALSE(map.exists(1));
+
+    map.clear();
+    ASSERT_TRUE(map.empty());
+}
+
+TEST(ConcurrentEvictingCacheMapTest, Expiry) {
+    using namespace std::chrono_literals;
+
+    auto map = ConcurrentEvictingCacheMap<int, int>(64, 4);
+    map.put(1, 2, 1ns);
+    map.put(3, 4, 1h);
+
+    std::this_thread::sleep_for(1ms);
+    ASSERT_FALSE(map.get(1).has_value());
+    ASSERT_FALSE(map.exists(1));
+    ASSERT_EQ(map.get(3).value(), 4);
+}
+
+TEST(ConcurrentEvictingCacheMapTest, RemovalOutOfLock) {
+    auto map = ConcurrentEvictingCacheMap<int, int>(2, 1);
+
+    vector<int> evicted;
+    map.setRemovalListener([&](std::pair<int, int> && kv, RemovalCause cause) {
+        //  would deadlock under the shard lock
+        ASSERT_FALSE(map.exists(kv.first));
+        ASSERT_EQ(cause, RemovalCause::EVICTED);
+
+        evicted.push_back(kv.first);
+    });
+
+    map.put(1, 1);
+    map.put(2, 2);
+    map.put(3, 3);
+    map.getOrPut(4, 4);
+
+    ASSERT_EQ(evicted, vector<int>({ 1, 2 }));
+}
+
+TEST(ConcurrentEvictingCacheMapTest, Heterogeneous) {
+    auto map = ConcurrentEvictingCacheMap<std::string, int, StringHash>(64, 4);
+    map.put(std::string("alpha"), 1);
+
+    std::string_view key = "alpha";
+    ASSERT_TRUE(map.exists(key));
+    ASSERT_EQ(map.get(key).value(), 1);
+    ASSERT_TRUE(map.erase(key));
+    ASSERT_FALSE(map.exists("alpha"));
+}
+
+struct CountingHash {
+    size_t * calls;
+
+    size_t operator()(const std::string & key) const {
+        ++*calls;
+        return std::hash<std::string>()(key);
+    }
+};
+
+TEST(ConcurrentEvictingCacheMapTest, HashesOnce) {
+    size_t calls = 0;
+    auto map = ConcurrentEvictingCacheMap<std::string, int, CountingHash>(64, 4, CountingHash{ &calls });
+    for (int i = 0; i < 10; ++i) {
+        map.put(std::to_string(i), i);
+    }
+
+    //  the shard and the shard map share the hash of every operation
+    calls = 0;
+    map.put(std::string("9"), 90);
+    map.get("9");
+    map.exists("9");
+    map.getOrPut(std::string("9"), 2);
+    map.try_emplace(std::string("9"), 1);
+    map.getOrCompute("9", [](const std::string &) {
+        return 3;
+    });
+    map.erase("missing");
+    ASSERT_EQ(calls, 7u);
+}
+
+TEST(ConcurrentEvictingCacheMapTest, Stats) {
+    auto map = ConcurrentEvictingCacheMap<int, int, std::hash<int>, LruPolicy, CountingStats>(64, 4);
+    for (int i = 0; i < 100; ++i) {
+        map.put(i, i);
+    }
+
+    for (int i = 0; i < 100; ++i) {
+        map.get(i);
+    }
+    map.getOrPut(200, 200);
+
+    auto stats = map.stats();
+    ASSERT_EQ(stats.hits + stats.misses, 101u);
+    ASSERT_EQ(stats.hits, map.size());
+    ASSERT_EQ(stats.insertions, 101u);
+    ASSERT_EQ(stats.evictions + map.size(), 101u);
+    ASSERT_EQ(stats.indexed, map.size());
+
+    map.resetStats();
+    ASSERT_EQ(map.stats().hits, 0u);
+}
+
+TEST(ConcurrentEvictingCacheMapTest, ShardCount) {
+    ASSERT_THROW((ConcurrentEvictingCacheMap<int, int>(10, 0)), std::invalid_argument);
+    ASSERT_EQ((ConcurrentEvictingCacheMap<int, int>(10, 1).shardCount()), 1u);
+    ASSERT_EQ((ConcurrentEvictingCacheMap<int, int>(10, 5).shardCount()), 8u);
+}
+
+TEST(ConcurrentEvictingCacheMapTest, Capacity) {
+    auto map = ConcurrentEvictingCacheMap<int, int>(100, 4);
+    for (int i = 0; i < 10000; ++i) {
+        map.put(i, i);
+    }
+
+    ASSERT_LE(map.size(), 100u);
+    ASSERT_EQ(map.get(9999).value(), 9999);
+}
+
+TEST(ConcurrentEvictingCacheMapTest, GetOrPut) {
+    auto map = ConcurrentEvictingCacheMap<int, int>(100, 4);
+    ASSERT_EQ(map.getOrPut(1, 1), 1);
+    ASSERT_EQ(map.getOrPut(1, 2), 1);
+    ASSERT_EQ(map.get(1).value(), 1);
+}
+
+TEST(ConcurrentEvictingCacheMapTest, GetOrComputeSingleFlight) {
+    const int threadCount = 8;
+    auto map = ConcurrentEvictingCacheMap<int, int>(100, 4);
+
+    std::atomic<int> loads(0);
+    vector<int> seen(threadCount);
+    vector<thread> threads;
+    for (int t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&map, &loads, &seen, t] {
+            seen[t] = map.getOrCompute(7, [&loads, t](int key) {
+                ++loads;
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                return key * 100 + t;
+            });
+        });
+    }
+
+    for (auto & th : threads) {
+        th.join();
+    }
+
+    //  the threads which started during the load waited for it
+    ASSERT_EQ(loads, 1);
+    for (int t = 1; t < threadCount; ++t) {
+        ASSERT_EQ(seen[t], seen[0]);
+    }
+    ASSERT_EQ(map.get(7).value(), seen[0]);
+}
+
+TEST(ConcurrentEvictingCacheMapTest, GetOrComputeException) {
+    auto map = ConcurrentEvictingCacheMap<int, int>(100, 4);
+
+    std::atomic<bool> loading(false);
+    std::atomic<bool> waiterLoaded(false);
+    bool waiterFailed = false;
+
+    thread leader([&map, &loading] {
+        ASSERT_THROW(map.getOrCompute(1, [&loading](int) -> int {
+            loading = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            throw std::runtime_error("backend down");
+        }), std::runtime_error);
+    });
+
+    while (!loading)
+        std::this_thread::yield();
+
+    thread waiter([&map, &waiterLoaded, &waiterFailed] {
+        try {
+            map.getOrCompute(1, [&waiterLoaded](int) {
+                waiterLoaded = true;
+                return 0;
+            });
+        } catch (const std::runtime_error &) {
+            waiterFailed = true;
+        }
+    });
+
+    leader.join();
+    waiter.join();
+
+    ASSERT_TRUE(waiterFailed);
+    ASSERT_FALSE(waiterLoaded);
+    ASSERT_FALSE(map.exists(1));
+
+    //  a failed load is not cached: the next call loads again
+    ASSERT_EQ(map.getOrCompute(1, [](int key) {
+        return key + 1;
+    }), 2);
+}
+
+TEST(ConcurrentEvictingCacheMapTest, GetOrComputeListenerThrows) {
+    auto map = ConcurrentEvictingCacheMap<int, int>(1, 1);
+    map.setRemovalListener([](std::pair<int, int> &&, RemovalCause) {
+        throw std::logic_error("listener");
+    });
+    map.put(1, 1);
+
+    std::atomic<bool> loading(false);
+    int waiterSeen = 0;
+
+    //  the put evicts 1 and the listener throws, but the load succeeded
+    thread leader([&map, &loading] {
+        ASSERT_THROW(map.getOrCompute(2, [&loading](int key) {
+            loading = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            return key * 10;
+        }), std::logic_error);
+    });
+
+    while (!loading)
+        std::this_thread::yield();
+
+    thread waiter([&map, &waiterSeen] {
+        waiterSeen = map.getOrCompute(2, [](int) -> int {
+            throw std::runtime_error("loaded twice");
+        });
+    });
+
+    leader.join();
+    waiter.join();
+
+    ASSERT_EQ(waiterSeen, 20);
+    ASSERT_EQ(map.get(2).value(), 20);
+
+    //  and the load is over: a new miss loads again
+    map.setRemovalListener(nullptr);
+    map.erase(2);
+    ASSERT_EQ(map.getOrCompute(2, [](int key) {
+        return key * 100;
+    }), 200);
+}
+
+TEST(ConcurrentEvictingCacheMapTest, VisitTryEmplace) {
+    auto map = ConcurrentEvictingCacheMap<int, std::string>(100, 4);
+    ASSERT_TRUE(map.try_emplace(1, 3, 'a'));
+    ASSERT_FALSE(map.try_emplace(1, 3, 'b'));
+
+    size_t length = 0;
+    ASSERT_TRUE(map.visit(1, [&length](const std::string & value) {
+        length = value.size();
+    }));
+    ASSERT_EQ(length, 3u);
+    ASSERT_FALSE(map.visit(2, [](const std::string &) {
+        FAIL();
+    }));
+    ASSERT_EQ(map.get(1).value(), "aaa");
+}
+
+TEST(ConcurrentEvictingCacheMapTest, GetOrPutRace) {
+    const int threadCount = 8;
+    auto map = ConcurrentEvictingCacheMap<int, int>(1000, 4);
+
+    vector<vector<int>> seen(threadCount);
+    vector<thread> threads;
+    for (int t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&map, &seen, t] {
+            for (int key = 0; key < 500; ++key) {
+                seen[t].push_back(map.getOrPut(key, t));
+            }
+        });
+    }
+
+    for (auto & th : threads) {
+        th.join();
+    }
+
+    //  every thread got the value of the one that put the key first
+    for (int t = 1; t < threadCount; ++t) {
+        ASSERT_EQ(seen[t], seen[0]);
+    }
+}
+
+TEST(ConcurrentEvictingCacheMapTest, Stress) {
+    const int threadCount = 8;
+    auto map = ConcurrentEvictingCacheMap<int, int>(256, 8);
+
+    std::atomic<bool> mismatch(false);
+    vector<thread> threads;
+    for (int t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&map, &mismatch, t] {
+            unsigned seed = 17u * (t + 1);
+            for (int i = 0; i < 20000; ++i) {
+                seed = seed * 1103515245 + 12345;
+                int key = static_cast<int>((seed >> 16) % 1024);
+
+                switch ((seed >> 8) % 4) {
+                    case 0:
+                        map.erase(key);
+                        break;
+                    case 1: {
+                        auto value = map.get(key);
+                        if (value.has_value() && *value != key * 2)
+                            mismatch = true;
+                        break;
+                    }
+                    default:
+                        map.put(key, key * 2);
+                }
+            }
+        });
+    }
+
+    for (auto & th : threads) {
+        th.join();
+    }
+
+    ASSERT_FALSE(mismatch);
+    ASSERT_LE(map.size(), 256u);
+}
+
+TEST(ConcurrentEvictingCacheMapTest, BufferedPromotion) {
+    auto map = ConcurrentEvictingCacheMap<int, int>(4, 1);
+    map.put(1, 1);
+    map.put(2, 2);
+    map.put(3, 3);
+    map.put(4, 4);
+
+    map.get(1);     //  recorded, applied before the next write
+    map.put(5, 5);  //  evict {2, 2}
+
+    ASSERT_TRUE(map.exists(1));
+    ASSERT_FALSE(map.exists(2));
+}
+
+TEST(ConcurrentEvictingCacheMapTest, BufferOverflow) {
+    auto map = ConcurrentEvictingCacheMap<int, int>(4, 1);
+    map.put(1, 1);
+    map.put(2, 2);
+    map.put(3, 3);
+    map.put(4, 4);
+
+    //  fill the buffer several times; the reads drain it on their own
+    for (int i = 0; i < 1000; ++i) {
+        ASSERT_EQ(map.get(1 + i % 3).value(), 1 + i % 3);
+    }
+
+    map.put(5, 5);  //  evict {4, 4}
+    ASSERT_FALSE(map.exists(4));
+    ASSERT_TRUE(map.exists(1));
+    ASSERT_TRUE(map.exists(2));
+    ASSERT_TRUE(map.exists(3));
+}
+
+TEST(ConcurrentEvictingCacheMapTest, ReadMostly) {
+    const int threadCount = 8;
+    auto map = ConcurrentEvictingCacheMap<int, int>(512, 4);
+    for (int i = 0; i < 512; ++i) {
+        map.put(i, i);
+    }
+
+    std::atomic<bool> mismatch(false);
+    vector<thread> threads;
+    for (int t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&map, &mismatch, t] {
+            for (int i = 0; i < 20000; ++i) {
+                int key = (i * 7 + t) % 1024;
+                if (i % 50 == 0) {
+                    map.put(key, key);
+                    continue;
+                }
+
+                auto value = map.get(key);
+                if (value.has_value() && *value != key)
+                    mismatch = true;
+            }
+        });
+    }
+
+    for (auto & th : threads) {
+        th.join();
+    }
+
+    ASSERT_FALSE(mismatch);
+    ASSERT_LE(map.size(), 512u);
+}
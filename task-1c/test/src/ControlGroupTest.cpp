@@ -0,0 +1,32 @@
+#include <cstdint>
+
+#include <gtest/gtest.h>
+
+#include <ControlGroup.h>
+
+using std::uint8_t;
+
+TEST(ControlGroupTest, Match) {
+    uint8_t controls[ControlGroup::SIZE];
+    for (std::size_t i = 0; i < ControlGroup::SIZE; ++i) {
+        controls[i] = static_cast<uint8_t>(i % 4);
+    }
+    controls[5] = ControlGroup::EMPTY;
+    controls[9] = ControlGroup::DELETED;
+    controls[15] = 0x7F;
+
+    ControlGroup group(controls);
+    ASSERT_EQ(group.match(0), 0x1111u);
+    ASSERT_EQ(group.match(1), 0x2002u);     //  5 and 9 overwritten
+    ASSERT_EQ(group.match(3), 0x0888u);
+    ASSERT_EQ(group.match(0x7F), 0x8000u);
+    ASSERT_EQ(group.match(0x42), 0u);
+    ASSERT_EQ(group.matchEmpty(), 0x0020u);
+    ASSERT_EQ(group.matchFree(), 0x0220u);
+}
+
+TEST(ControlGroupTest, LowestBit) {
+    ASSERT_EQ(ControlGroup::lowestBit(1), 0u);
+    ASSERT_EQ(ControlGroup::lowestBit(0x0220), 5u);
+    ASSERT_EQ(ControlGroup::lowestBit(0x8000), 15u);
+}
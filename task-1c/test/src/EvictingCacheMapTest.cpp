@@ -1,5 +1,19 @@
 #include "EvictingCacheMapTest.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+
 #include <gmock/gmock.h>
 
 #include <EvictingCacheMap.h>
@@ -442,4 +456,1724 @@ TEST_F(EvictingCacheMapTest, RehashTraceable) {
     ASSERT_LE(kvTraces[0].second.getCopyCalls(), 0);
     ASSERT_LE(kvTraces[1].first.getCopyCalls(), 0);
     ASSERT_LE(kvTraces[1].second.getCopyCalls(), 0);
-}
\ No newline at end of file
+}
+
+//  storage
+
+TEST_F(EvictingCacheMapTest, GrowKeepsEntries) {
+    vector<Traceable> keys;
+    vector<const Traceable::Trace *> keyTraces;
+    for (int i = 0; i < 100; ++i) {
+        keys.push_back(createTraceable());
+        keyTraces.push_back(&keys.back().getTrace());
+    }
+
+    auto map = EvictingCacheMap<Traceable, int>(100);
+    for (int i = 0; i < 100; ++i) {
+        map.put(move(keys[i]), i);   //  the slot array grows several times
+    }
+
+    ASSERT_EQ(map.size(), 100u);
+
+    int expected = 99;
+    for (auto & kv : map) {
+        ASSERT_EQ(kv.second, expected--);
+        ASSERT_LE(kv.first.getTrace().getCopyCalls(), 0);
+    }
+
+    for (auto trace : keyTraces) {
+        ASSERT_TRUE(trace->isAlive());
+    }
+}
+
+TEST_F(EvictingCacheMapTest, ReferenceModel) {
+    const size_t capacity = 64;
+
+    auto map = EvictingCacheMap<int, int>(capacity);
+    auto model = list<pair<const int, int>>();
+
+    unsigned seed = 12345;
+    for (int i = 0; i < 20000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        int key = static_cast<int>((seed >> 16) % 200);
+        int op = static_cast<int>((seed >> 8) % 4);
+
+        auto it = model.begin();
+        while (it != model.end() && it->first != key)
+            ++it;
+
+        if (op == 0) {
+            ASSERT_EQ(map.erase(key), it != model.end());
+            if (it != model.end())
+                model.erase(it);
+        } else if (op == 1) {
+            auto value = map.get(key);
+            ASSERT_EQ(value.has_value(), it != model.end());
+            if (it != model.end()) {
+                ASSERT_EQ(*value, it->second);
+                model.splice(model.begin(), model, it);
+            }
+        } else {
+            map.put(key, i);
+            if (it != model.end())
+                model.erase(it);
+            model.emplace_front(key, i);
+            if (model.size() > capacity)
+                model.pop_back();
+        }
+
+        ASSERT_EQ(map.size(), model.size());
+    }
+
+    ASSERT_THAT(map, ::testing::ElementsAreArray(model.begin(), model.end()));
+}
+
+//  keys in long runs of equal hashes and tags, erased and put back, so that
+//  lookups go through many groups and deleted buckets
+template <bool INCREMENTAL>
+static void churnCollisions() {
+    struct FewHashes {
+        size_t operator()(int key) const {
+            return static_cast<size_t>(key % 40);
+        }
+    };
+
+    auto map = EvictingCacheMap<int, int, FewHashes>(1000);
+    map.setIncrementalRehash(INCREMENTAL);
+    auto model = std::set<int>();
+
+    unsigned seed = 54321;
+    for (int i = 0; i < 50000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        int key = static_cast<int>((seed >> 16) % 1000);
+
+        if ((seed >> 8) % 3 == 0) {
+            ASSERT_EQ(map.erase(key), model.erase(key) == 1);
+        } else if ((seed >> 8) % 3 == 1) {
+            ASSERT_EQ(map.exists(key), model.count(key) == 1);
+        } else {
+            map.put(key, key);
+            model.insert(key);
+        }
+    }
+
+    ASSERT_EQ(map.size(), model.size());
+    for (int key = 0; key < 1000; ++key) {
+        ASSERT_EQ(map.exists(key), model.count(key) == 1) << key;
+    }
+}
+
+TEST_F(EvictingCacheMapTest, RehashCollisionChurn) {
+    churnCollisions<false>();
+    churnCollisions<true>();
+}
+
+TEST_F(EvictingCacheMapTest, IteratorDecrement) {
+    auto map = EvictingCacheMap<int, int>(3);
+    map.put(1, 1);
+    map.put(2, 2);
+    map.put(3, 3);
+
+    auto it = map.end();
+    ASSERT_EQ((--it)->first, 1);
+    ASSERT_EQ((--it)->first, 2);
+    ASSERT_EQ((--it)->first, 3);
+    ASSERT_TRUE(it == map.begin());
+
+    auto order = vector<int>();
+    for (auto rit = map.rbegin(); rit != map.rend(); ++rit) {
+        order.push_back(rit->first);
+    }
+    ASSERT_THAT(order, ::testing::ElementsAre(1, 2, 3));
+}
+
+TEST_F(EvictingCacheMapTest, StringKeys) {
+    auto map = EvictingCacheMap<std::string, std::string>(2);
+    map.put(std::string("a"), std::string(100, 'a'));
+    map.put(std::string("b"), std::string(100, 'b'));
+    map.put(std::string("c"), std::string(100, 'c'));   //  evict "a"
+
+    ASSERT_FALSE(map.exists("a"));
+    ASSERT_EQ(map.get("b").value(), std::string(100, 'b'));
+    ASSERT_EQ(map.get("c").value(), std::string(100, 'c'));
+}
+
+//  incremental rehash
+
+struct CountingHash {
+    size_t * calls = nullptr;
+
+    size_t operator()(int key) const {
+        ++*calls;
+        return std::hash<int>()(key);
+    }
+};
+
+static size_t maxHashesPerPut(bool incremental, int n) {
+    size_t calls = 0;
+    auto map = EvictingCacheMap<int, int, CountingHash>(n / 2, CountingHash{ &calls });
+    map.setIncrementalRehash(incremental);
+
+    size_t worst = 0;
+    for (int i = 0; i < n; ++i) {
+        auto before = calls;
+        map.put(i, i);
+        worst = std::max(worst, calls - before);
+    }
+
+    return worst;
+}
+
+TEST_F(EvictingCacheMapTest, RehashIncrementalBounded) {
+    //  a put hashes its key, the evicted key and at most one key per migrated
+    //  bucket (two steps of 16: eviction and insertion), whatever the size of
+    //  the map
+    ASSERT_LE(maxHashesPerPut(true, 1 << 16), 34u);
+    ASSERT_GT(maxHashesPerPut(false, 1 << 16), 1000u);
+}
+
+TEST_F(EvictingCacheMapTest, RehashIncrementalLookups) {
+    size_t calls = 0;
+    auto map = EvictingCacheMap<int, int, CountingHash>(10000, CountingHash{ &calls });
+    map.setIncrementalRehash(true);
+
+    for (int i = 0; i < 10000; ++i) {
+        map.put(i, i);
+
+        //  keys still in the old buckets are found as well
+        ASSERT_TRUE(map.exists(i / 2));
+        ASSERT_TRUE(map.exists(i));
+    }
+
+    for (int i = 0; i < 10000; i += 2) {
+        ASSERT_TRUE(map.erase(i));
+    }
+
+    for (int i = 0; i < 10000; ++i) {
+        ASSERT_EQ(map.get(i).has_value(), i % 2 == 1);
+    }
+
+    map.setIncrementalRehash(false);
+    ASSERT_EQ(map.size(), 5000u);
+    ASSERT_EQ(map.get(9999).value(), 9999);
+}
+
+//  sizing
+
+TEST_F(EvictingCacheMapTest, Reserve) {
+    size_t calls = 0;
+    auto map = EvictingCacheMap<int, int, CountingHash>(1000, CountingHash{ &calls });
+    map.reserve(5000);  //  limited to the capacity
+
+    auto buckets = map.bucket_count();
+    for (int i = 0; i < 1000; ++i) {
+        map.put(i, i);
+    }
+
+    ASSERT_EQ(calls, 1000u);    //  no rehash
+    ASSERT_EQ(map.bucket_count(), buckets);
+}
+
+TEST_F(EvictingCacheMapTest, Preallocate) {
+    auto map = EvictingCacheMap<int, int>(1000, PREALLOCATE);
+    auto buckets = map.bucket_count();
+    ASSERT_GE(buckets * map.max_load_factor(), 1000u);
+
+    for (int i = 0; i < 100000; ++i) {
+        map.put(i, i);
+        if (i % 3 == 0)
+            map.erase(i - 500);
+    }
+
+    ASSERT_EQ(map.bucket_count(), buckets);
+}
+
+TEST_F(EvictingCacheMapTest, BoundedIndex) {
+    auto preallocated = EvictingCacheMap<int, int>(1000, PREALLOCATE);
+    auto map = EvictingCacheMap<int, int>(1000);
+
+    for (int i = 0; i < 100000; ++i) {
+        map.put(i, i);
+        ASSERT_LE(map.bucket_count(), preallocated.bucket_count());
+    }
+
+    ASSERT_EQ(map.size(), 1000u);
+    ASSERT_LE(map.load_factor(), map.max_load_factor());
+}
+
+TEST_F(EvictingCacheMapTest, ShrinkToFit) {
+    auto map = EvictingCacheMap<int, int>(1000);
+    for (int i = 0; i < 1000; ++i) {
+        map.put(i, i);
+    }
+
+    for (int i = 0; i < 990; ++i) {
+        map.erase(i);
+    }
+    map.get(995);
+
+    auto order = vector<pair<const int, int>>(map.begin(), map.end());
+    auto buckets = map.bucket_count();
+
+    map.shrink_to_fit();
+    ASSERT_LT(map.bucket_count(), buckets);
+    ASSERT_THAT(map, ::testing::ElementsAreArray(order.begin(), order.end()));
+
+    map.put(0, 0);
+    ASSERT_EQ(map.get(0).value(), 0);
+    ASSERT_EQ(map.get(999).value(), 999);
+
+    map.clear();
+    map.shrink_to_fit();
+    ASSERT_EQ(map.bucket_count(), 0u);
+
+    map.put(1, 1);
+    ASSERT_EQ(map.get(1).value(), 1);
+}
+
+TEST_F(EvictingCacheMapTest, MaxLoadFactor) {
+    auto map = EvictingCacheMap<int, int>(1000);
+    ASSERT_THROW(map.max_load_factor(0.0f), std::invalid_argument);
+    ASSERT_THROW(map.max_load_factor(1.0f), std::invalid_argument);
+
+    for (int i = 0; i < 1000; ++i) {
+        map.put(i, i);
+    }
+
+    map.max_load_factor(0.25f);
+    ASSERT_LE(map.load_factor(), 0.25f);
+
+    for (int i = 1000; i < 3000; ++i) {
+        map.put(i, i);
+        ASSERT_LE(map.load_factor(), 0.25f);
+    }
+
+    ASSERT_EQ(map.get(2999).value(), 2999);
+}
+
+//  deferred promotion
+
+TEST_F(EvictingCacheMapTest, ConstFind) {
+    auto map = EvictingCacheMap<int, int>(2);
+    map.put(1, 2);
+    map.put(3, 4);
+
+    const auto & constMap = map;
+    auto it = constMap.find(1);     //  no promotion
+    ASSERT_EQ(it->second, 2);
+    ASSERT_EQ(constMap.find(5), constMap.end());
+
+    map.promote(it);
+    map.put(5, 6);  //  evict {3, 4}
+
+    ASSERT_TRUE(map.exists(1));
+    ASSERT_FALSE(map.exists(3));
+}
+
+TEST_F(EvictingCacheMapTest, PromoteErased) {
+    auto map = EvictingCacheMap<int, int>(2);
+    map.put(1, 2);
+    map.put(3, 4);
+
+    auto it = std::as_const(map).find(1);
+    map.erase(1);
+    map.promote(it);    //  ignored
+
+    ASSERT_EQ(map.size(), 1u);
+    ASSERT_EQ(map.begin()->first, 3);
+}
+
+//  weight
+
+struct LengthWeigher {
+    size_t operator()(int, const std::string & value) const {
+        return value.size();
+    }
+};
+
+using WeightedMap = EvictingCacheMap<int, std::string, std::hash<int>, LruPolicy, LengthWeigher>;
+
+TEST_F(EvictingCacheMapTest, UnitWeight) {
+    auto map = EvictingCacheMap<int, int>(3);
+    for (int i = 0; i < 5; ++i) {
+        map.put(i, i);
+        ASSERT_EQ(map.totalWeight(), map.size());
+    }
+
+    map.setMaxWeight(1);
+    ASSERT_EQ(map.size(), 1u);
+    ASSERT_TRUE(map.exists(4));
+}
+
+TEST_F(EvictingCacheMapTest, Weight) {
+    auto map = WeightedMap(100, 10);
+    map.put(1, std::string(4, 'a'));
+    map.put(2, std::string(4, 'b'));
+    ASSERT_EQ(map.totalWeight(), 8u);
+
+    map.put(3, std::string(3, 'c'));    //  evict {1, aaaa}
+    ASSERT_EQ(map.totalWeight(), 7u);
+    ASSERT_FALSE(map.exists(1));
+
+    map.put(2, std::string(1, 'b'));    //  replaced: lighter
+    ASSERT_EQ(map.totalWeight(), 4u);
+
+    map.put(4, std::string(6, 'd'));    //  fits without eviction
+    ASSERT_EQ(map.size(), 3u);
+    ASSERT_EQ(map.totalWeight(), 10u);
+
+    map.put(3, std::string(5, 'c'));    //  replaced: heavier, evict {2, b} and {4, dddddd}
+    ASSERT_EQ(map.size(), 1u);
+    ASSERT_EQ(map.totalWeight(), 5u);
+
+    map.erase(3);
+    ASSERT_EQ(map.totalWeight(), 0u);
+}
+
+TEST_F(EvictingCacheMapTest, WeightTooHeavy) {
+    auto map = WeightedMap(100, 10);
+    map.put(1, std::string(5, 'a'));
+    map.put(2, std::string(11, 'b'));   //  never kept
+
+    ASSERT_FALSE(map.exists(2));
+    ASSERT_TRUE(map.exists(1));
+
+    map.put(1, std::string(11, 'a'));   //  the key goes away
+    ASSERT_TRUE(map.empty());
+    ASSERT_EQ(map.totalWeight(), 0u);
+}
+
+TEST_F(EvictingCacheMapTest, WeightAndCapacity) {
+    auto map = WeightedMap(2, 100);
+    map.put(1, "a");
+    map.put(2, "b");
+    map.put(3, "c");    //  evict by size
+
+    ASSERT_EQ(map.size(), 2u);
+    ASSERT_EQ(map.totalWeight(), 2u);
+
+    map.setMaxWeight(1);
+    ASSERT_EQ(map.size(), 1u);
+    ASSERT_TRUE(map.exists(3));
+}
+
+TEST_F(EvictingCacheMapTest, WeightKeptOnStorageChanges) {
+    auto map = WeightedMap(1000, 100000);
+    for (int i = 0; i < 1000; ++i) {
+        map.put(i, std::string(i % 7, 'x'));
+    }
+    for (int i = 0; i < 900; ++i) {
+        map.erase(i);
+    }
+
+    size_t expected = 0;
+    for (auto & kv : map) {
+        expected += kv.second.size();
+    }
+    ASSERT_EQ(map.totalWeight(), expected);
+
+    map.shrink_to_fit();
+    ASSERT_EQ(map.totalWeight(), expected);
+
+    auto copy = map;
+    ASSERT_EQ(copy.totalWeight(), expected);
+
+    for (int i = 0; i < 100; ++i) {
+        copy.erase(900 + i);
+    }
+    ASSERT_EQ(copy.totalWeight(), 0u);
+
+    auto moved = std::move(map);
+    ASSERT_EQ(moved.totalWeight(), expected);
+    moved.clear();
+    ASSERT_EQ(moved.totalWeight(), 0u);
+}
+
+//  expiry
+
+struct ManualClock {
+    using duration = std::chrono::nanoseconds;
+    using time_point = std::chrono::time_point<std::chrono::steady_clock, duration>;
+
+    const duration * time = nullptr;
+
+    time_point now() const {
+        return time_point(*time);
+    }
+};
+
+using ExpiringMap = EvictingCacheMap<int, int, std::hash<int>, LruPolicy, UnitWeigher, ManualClock>;
+
+static ExpiringMap expiringMap(size_t capacity, const std::chrono::nanoseconds & time) {
+    return ExpiringMap(capacity, SIZE_MAX, std::hash<int>(), UnitWeigher(), ManualClock{ &time });
+}
+
+TEST_F(EvictingCacheMapTest, Expiry) {
+    using namespace std::chrono_literals;
+
+    auto time = std::chrono::nanoseconds(1h);
+    auto map = expiringMap(10, time);
+
+    map.put(1, 1, 10s);
+    map.put(2, 2, 20s);
+    map.put(3, 3);      //  no TTL
+
+    time += 10s - 1ns;
+    ASSERT_TRUE(map.exists(1));
+
+    time += 1ns;
+    ASSERT_FALSE(map.exists(1));
+    ASSERT_FALSE(map.get(1).has_value());
+    ASSERT_EQ(std::as_const(map).find(2)->second, 2);
+
+    time += 1h;
+    ASSERT_FALSE(map.exists(2));
+    ASSERT_FALSE(map.erase(2));
+    ASSERT_EQ(map.get(3).value(), 3);
+}
+
+TEST_F(EvictingCacheMapTest, ExpiryReclaimed) {
+    using namespace std::chrono_literals;
+
+    auto time = std::chrono::nanoseconds(0);
+    auto map = expiringMap(1000, time);
+
+    for (int i = 0; i < 1000; ++i) {
+        map.put(i, i, std::chrono::seconds(1 + i % 100));
+    }
+
+    //  the wheel reclaims entries on later operations, at most a bucket late
+    time += 50s;
+    map.put(-1, -1);
+    ASSERT_LE(map.size(), 1000u - 480u);
+    ASSERT_GE(map.size(), 1000u - 510u);
+
+    map.removeExpired();
+    ASSERT_EQ(map.size(), 1000u - 500u + 1u);
+    for (auto & kv : map) {
+        ASSERT_TRUE(kv.first == -1 || kv.first % 100 >= 50);
+    }
+
+    time += 1000h;
+    map.removeExpired();
+    ASSERT_EQ(map.size(), 1u);
+}
+
+TEST_F(EvictingCacheMapTest, ExpiryDefaultTtl) {
+    using namespace std::chrono_literals;
+
+    auto time = std::chrono::nanoseconds(0);
+    auto map = expiringMap(10, time);
+    map.setDefaultTtl(5min);
+    ASSERT_EQ(map.getDefaultTtl(), 5min);
+    ASSERT_THROW(map.setDefaultTtl(-1s), std::invalid_argument);
+
+    map.put(1, 1);
+    map.put(2, 2, 0s);  //  forever
+
+    time += 4min;
+    map.put(1, 10);     //  replacing restarts the TTL
+
+    time += 4min;
+    ASSERT_EQ(map.get(1).value(), 10);
+
+    time += 1min;
+    ASSERT_FALSE(map.exists(1));
+    ASSERT_TRUE(map.exists(2));
+
+    map.put(1, 1);      //  the expired entry is replaced by a fresh one
+    ASSERT_EQ(map.get(1).value(), 1);
+    ASSERT_EQ(map.size(), 2u);
+}
+
+TEST_F(EvictingCacheMapTest, ExpiryKeptOnStorageChanges) {
+    using namespace std::chrono_literals;
+
+    auto time = std::chrono::nanoseconds(0);
+    auto map = expiringMap(100, time);
+
+    for (int i = 0; i < 100; ++i) {
+        map.put(i, i, std::chrono::minutes(1 + i % 2));
+    }
+    for (int i = 0; i < 50; ++i) {
+        map.erase(i);
+    }
+    map.shrink_to_fit();
+
+    auto copy = map;
+
+    time += 1min;
+    copy.removeExpired();
+    map.removeExpired();
+    ASSERT_EQ(map.size(), 25u);
+    ASSERT_EQ(copy.size(), 25u);
+
+    auto moved = std::move(map);
+    time += 1min;
+    moved.removeExpired();
+    ASSERT_TRUE(moved.empty());
+
+    copy.clear();
+    copy.put(1, 1);
+    time += 1h;
+    ASSERT_TRUE(copy.exists(1));
+}
+
+TEST_F(EvictingCacheMapTest, ExpiryNeverStartsTimers) {
+    auto map = ExpiringMap(10, SIZE_MAX, std::hash<int>(), UnitWeigher(), ManualClock());
+
+    //  the clock would crash if read
+    map.put(1, 1);
+    ASSERT_EQ(map.get(1).value(), 1);
+    ASSERT_TRUE(map.exists(1));
+    ASSERT_TRUE(map.erase(1));
+    map.removeExpired();
+}
+
+//  removal listener
+
+TEST_F(EvictingCacheMapTest, RemovalCauses) {
+    using namespace std::chrono_literals;
+
+    auto time = std::chrono::nanoseconds(0);
+    auto map = expiringMap(2, time);
+
+    vector<pair<int, RemovalCause>> removed;
+    map.setRemovalListener([&removed](pair<int, int> && kv, RemovalCause cause) {
+        removed.emplace_back(kv.first * 100 + kv.second, cause);
+    });
+
+    map.put(1, 1);
+    map.put(2, 2);
+    map.put(3, 3);      //  evict {1, 1}
+    map.put(2, 4);      //  replace {2, 2}
+    map.erase(3);
+    map.put(5, 5, 1s);
+    time += 1s;
+    ASSERT_FALSE(map.get(5).has_value());
+    map.clear();        //  {2, 4}
+
+    vector<pair<int, RemovalCause>> expected = {
+            { 101, RemovalCause::EVICTED },
+            { 202, RemovalCause::REPLACED },
+            { 303, RemovalCause::ERASED },
+            { 505, RemovalCause::EXPIRED },
+            { 204, RemovalCause::CLEARED }
+    };
+    ASSERT_EQ(removed, expected);
+
+    map.setRemovalListener(nullptr);
+    map.put(1, 1);
+    map.clear();
+    ASSERT_EQ(removed.size(), expected.size());
+}
+
+TEST_F(EvictingCacheMapTest, RemovalMovesOut) {
+    auto map = EvictingCacheMap<int, std::unique_ptr<int>>(1);
+
+    vector<std::unique_ptr<int>> written;
+    map.setRemovalListener([&written](pair<int, std::unique_ptr<int>> && kv, RemovalCause) {
+        written.push_back(move(kv.second));
+    });
+
+    map.put(1, std::make_unique<int>(10));
+    map.put(2, std::make_unique<int>(20));
+
+    ASSERT_EQ(written.size(), 1u);
+    ASSERT_EQ(*written[0], 10);
+}
+
+struct MoveOnlyKey {
+    explicit MoveOnlyKey(int id)
+            : id(id) {
+    }
+
+    MoveOnlyKey(MoveOnlyKey &&) = default;
+    MoveOnlyKey & operator=(MoveOnlyKey &&) = default;
+
+    bool operator==(const MoveOnlyKey & other) const {
+        return id == other.id;
+    }
+
+    int id;
+};
+
+struct MoveOnlyKeyHash {
+    size_t operator()(const MoveOnlyKey & key) const {
+        return std::hash<int>()(key.id);
+    }
+};
+
+TEST_F(EvictingCacheMapTest, RemovalReplacedMoveOnlyKey) {
+    auto map = EvictingCacheMap<MoveOnlyKey, int, MoveOnlyKeyHash>(2);
+
+    vector<pair<int, RemovalCause>> removed;
+    map.setRemovalListener([&removed](pair<MoveOnlyKey, int> && kv, RemovalCause cause) {
+        removed.emplace_back(kv.first.id * 100 + kv.second, cause);
+    });
+
+    map.put(MoveOnlyKey(1), 1);
+    map.put(MoveOnlyKey(1), 2);     //  replace {1, 1}
+    map.put(MoveOnlyKey(2), 2);
+    map.put(MoveOnlyKey(3), 3);     //  evict {1, 2}
+
+    vector<pair<int, RemovalCause>> expected = {
+            { 101, RemovalCause::REPLACED },
+            { 102, RemovalCause::EVICTED }
+    };
+    ASSERT_EQ(removed, expected);
+}
+
+TEST_F(EvictingCacheMapTest, RemovalNoCopy) {
+    auto map = EvictingCacheMap<Traceable, Traceable>(1);
+    map.setRemovalListener([](pair<Traceable, Traceable> && kv, RemovalCause) {
+        auto kept = move(kv);
+    });
+
+    pair<Traceable, Traceable> kv = { createTraceable(), createTraceable() };
+    pair<const Traceable::Trace &, const Traceable::Trace &> kvTraces
+            = { kv.first.getTrace(), kv.second.getTrace() };
+
+    map.put(move(kv.first), move(kv.second));
+    map.put(createTraceable(), createTraceable());  //  evict kv
+
+    ASSERT_EQ(kvTraces.first.getCopyCalls(), 0);
+    ASSERT_EQ(kvTraces.second.getCopyCalls(), 0);
+}
+
+TEST_F(EvictingCacheMapTest, RemovalAfterCall) {
+    auto map = EvictingCacheMap<int, int>(2);
+    map.put(1, 1);
+    map.put(2, 2);
+
+    vector<int> evicted;
+    map.setRemovalListener([&](pair<int, int> && kv, RemovalCause) {
+        //  the put() is over and the map can be used
+        ASSERT_FALSE(map.exists(kv.first));
+        ASSERT_EQ(map.size(), 2u);
+
+        evicted.push_back(kv.first);
+        if (kv.first == 1) {
+            ASSERT_TRUE(map.exists(3));
+            map.put(4, 4);  //  evict {2, 2}, delivered by the same loop
+            ASSERT_EQ(evicted.size(), 1u);
+        }
+    });
+
+    map.put(3, 3);  //  evict {1, 1}
+
+    ASSERT_EQ(evicted, vector<int>({ 1, 2 }));
+}
+
+//  heterogeneous lookup
+
+struct CountedKey {
+    static int constructed;
+
+    int id;
+
+    CountedKey(int id) : id(id) {
+        ++constructed;
+    }
+
+    CountedKey(const CountedKey & other) : id(other.id) {
+        ++constructed;
+    }
+
+    friend bool operator==(const CountedKey & a, const CountedKey & b) {
+        return a.id == b.id;
+    }
+
+    friend bool operator==(const CountedKey & a, int b) {
+        return a.id == b;
+    }
+};
+
+int CountedKey::constructed = 0;
+
+struct CountedKeyHash {
+    using is_transparent = void;
+
+    size_t operator()(const CountedKey & key) const {
+        return std::hash<int>()(key.id);
+    }
+
+    size_t operator()(int id) const {
+        return std::hash<int>()(id);
+    }
+};
+
+TEST_F(EvictingCacheMapTest, HeterogeneousNoTemporaries) {
+    auto map = EvictingCacheMap<CountedKey, int, CountedKeyHash>(10);
+    for (int i = 0; i < 10; ++i) {
+        map.put(CountedKey(i), i);
+    }
+
+    CountedKey::constructed = 0;
+
+    ASSERT_TRUE(map.exists(3));
+    ASSERT_FALSE(map.exists(30));
+    ASSERT_EQ(map.get(4).value(), 4);
+    ASSERT_EQ(map.find(5)->second, 5);
+    ASSERT_EQ(std::as_const(map).find(6)->second, 6);
+    ASSERT_TRUE(map.erase(7));
+    ASSERT_FALSE(map.erase(7));
+
+    ASSERT_EQ(CountedKey::constructed, 0);
+}
+
+TEST_F(EvictingCacheMapTest, HeterogeneousStrings) {
+    auto map = EvictingCacheMap<std::string, int, StringHash>(10);
+    map.put(std::string("alpha"), 1);
+    map.put("beta", 2);
+
+    std::string_view buffer = "alpha beta gamma";
+    ASSERT_EQ(map.get(buffer.substr(0, 5)).value(), 1);
+    ASSERT_TRUE(map.exists(buffer.substr(6, 4)));
+    ASSERT_FALSE(map.exists(buffer.substr(11)));
+    ASSERT_TRUE(map.exists("beta"));
+    ASSERT_TRUE(map.exists(std::string("beta")));
+
+    ASSERT_TRUE(map.erase(buffer.substr(6, 4)));
+    ASSERT_EQ(map.size(), 1u);
+}
+
+//  in-place access
+
+struct Built {
+    static int constructed;
+
+    int value;
+
+    explicit Built(int value) : value(value) {
+        ++constructed;
+    }
+
+    Built(int a, int b) : value(a + b) {
+        ++constructed;
+    }
+};
+
+int Built::constructed = 0;
+
+TEST_F(EvictingCacheMapTest, VisitNoCopy) {
+    pair<Traceable, Traceable> kv = { createTraceable(), createTraceable() };
+    pair<const Traceable::Trace &, const Traceable::Trace &> kvTraces
+            = { kv.first.getTrace(), kv.second.getTrace() };
+
+    auto map = EvictingCacheMap<Traceable, Traceable>(1);
+    map.put(move(kv.first), move(kv.second));
+
+    const Traceable & key = map.begin()->first;    //  keys only equal themselves
+
+    const Traceable::Trace * visited = nullptr;
+    ASSERT_TRUE(map.visit(key, [&visited](Traceable & value) {
+        visited = &value.getTrace();
+    }));
+    ASSERT_EQ(visited, &kvTraces.second);
+    ASSERT_EQ(kvTraces.second.getCopyCalls(), 0);
+
+    ASSERT_EQ(map.peek(key), &map.begin()->second);
+    ASSERT_EQ(kvTraces.second.getCopyCalls(), 0);
+}
+
+TEST_F(EvictingCacheMapTest, VisitPromotes) {
+    auto map = EvictingCacheMap<int, int>(2);
+    map.put(1, 1);
+    map.put(2, 2);
+
+    ASSERT_TRUE(map.visit(1, [](int & value) {
+        value = 10;
+    }));
+    ASSERT_FALSE(map.visit(3, [](int &) {
+        FAIL();
+    }));
+
+    map.put(3, 3);      //  evict 2
+    ASSERT_FALSE(map.exists(2));
+    ASSERT_EQ(map.get(1).value(), 10);
+}
+
+TEST_F(EvictingCacheMapTest, PeekDoesNotPromote) {
+    auto map = EvictingCacheMap<int, int>(2);
+    map.put(1, 1);
+    map.put(2, 2);
+
+    ASSERT_EQ(*map.peek(1), 1);
+    ASSERT_EQ(std::as_const(map).peek(3), nullptr);
+    *map.peek(2) = 20;
+
+    map.put(3, 3);      //  evict 1 all the same
+    ASSERT_EQ(map.peek(1), nullptr);
+    ASSERT_EQ(*map.peek(2), 20);
+}
+
+TEST_F(EvictingCacheMapTest, PeekExpired) {
+    auto time = std::chrono::nanoseconds(0);
+    auto map = expiringMap(10, time);
+    map.put(1, 1, std::chrono::seconds(1));
+
+    ASSERT_NE(map.peek(1), nullptr);
+    time = std::chrono::seconds(1);
+    ASSERT_EQ(map.peek(1), nullptr);
+}
+
+TEST_F(EvictingCacheMapTest, TryEmplaceBuildsOnMiss) {
+    auto map = EvictingCacheMap<int, Built>(2);
+    Built::constructed = 0;
+
+    auto result = map.try_emplace(1, 2, 3);
+    ASSERT_TRUE(result.second);
+    ASSERT_EQ(result.first->second.value, 5);
+    ASSERT_EQ(Built::constructed, 1);
+
+    result = map.try_emplace(1, 7);
+    ASSERT_FALSE(result.second);
+    ASSERT_EQ(result.first->second.value, 5);
+    ASSERT_EQ(Built::constructed, 1);
+
+    map.try_emplace(2, 2);
+    map.try_emplace(1, 1);      //  promote 1
+    map.try_emplace(3, 3);      //  evict 2
+    ASSERT_FALSE(map.exists(2));
+    ASSERT_TRUE(map.exists(1));
+    ASSERT_EQ(Built::constructed, 3);
+}
+
+TEST_F(EvictingCacheMapTest, EmplacePiecewise) {
+    auto map = EvictingCacheMap<std::string, Built>(2);
+    Built::constructed = 0;
+
+    auto result = map.emplace(std::piecewise_construct,
+                              std::forward_as_tuple(3, 'a'), std::forward_as_tuple(4));
+    ASSERT_TRUE(result.second);
+    ASSERT_EQ(result.first->first, "aaa");
+
+    result = map.emplace(std::piecewise_construct,
+                         std::forward_as_tuple("aaa"), std::forward_as_tuple(1, 1));
+    ASSERT_FALSE(result.second);
+    ASSERT_EQ(result.first->second.value, 4);
+    ASSERT_EQ(Built::constructed, 1);
+}
+
+TEST_F(EvictingCacheMapTest, TryEmplaceWeighted) {
+    auto map = WeightedMap(100, 10);
+    map.put(1, std::string(6, 'a'));
+
+    ASSERT_TRUE(map.try_emplace(2, 4, 'b').second);
+    ASSERT_EQ(map.totalWeight(), 10u);
+
+    ASSERT_TRUE(map.try_emplace(3, 3, 'c').second);    //  evict {1, aaaaaa}
+    ASSERT_FALSE(map.exists(1));
+    ASSERT_EQ(map.totalWeight(), 7u);
+
+    auto result = map.try_emplace(4, 11, 'd');          //  never kept
+    ASSERT_FALSE(result.second);
+    ASSERT_EQ(result.first, map.end());
+    ASSERT_EQ(map.size(), 2u);
+    ASSERT_EQ(map.totalWeight(), 7u);
+
+    //  a full map evicts nothing for a value too heavy to keep
+    auto full = WeightedMap(2, 10);
+    full.put(1, "a");
+    full.put(2, "b");
+
+    vector<int> removed;
+    full.setRemovalListener([&removed](pair<int, std::string> && kv, RemovalCause) {
+        removed.push_back(kv.first);
+    });
+
+    ASSERT_FALSE(full.try_emplace(3, 11, 'x').second);
+    ASSERT_TRUE(full.exists(1));
+    ASSERT_TRUE(full.exists(2));
+    ASSERT_EQ(full.totalWeight(), 2u);
+    ASSERT_TRUE(removed.empty());
+
+    ASSERT_TRUE(full.try_emplace(3, 5, 'c').second);    //  evict {1, a}
+    ASSERT_EQ(removed, vector<int>{ 1 });
+    ASSERT_EQ(full.size(), 2u);
+    ASSERT_EQ(full.totalWeight(), 6u);
+    ASSERT_EQ(*full.peek(3), "ccccc");
+}
+
+TEST_F(EvictingCacheMapTest, InPlaceHeterogeneous) {
+    auto map = EvictingCacheMap<std::string, int, StringHash>(10);
+    map.try_emplace("alpha", 1);
+
+    std::string_view buffer = "alpha beta";
+    ASSERT_EQ(*map.peek(buffer.substr(0, 5)), 1);
+    ASSERT_EQ(map.peek(buffer.substr(6)), nullptr);
+    ASSERT_TRUE(map.visit(buffer.substr(0, 5), [](int & value) {
+        ++value;
+    }));
+    ASSERT_EQ(map.get("alpha").value(), 2);
+}
+
+//  statistics
+
+using CountingMap = EvictingCacheMap<int, int, std::hash<int>, LruPolicy, UnitWeigher,
+        ManualClock, CountingStats>;
+
+TEST_F(EvictingCacheMapTest, StatsCount) {
+    auto time = std::chrono::nanoseconds(0);
+    auto map = CountingMap(2, SIZE_MAX, std::hash<int>(), UnitWeigher(), ManualClock{ &time });
+
+    map.put(1, 1);
+    map.put(2, 2, std::chrono::seconds(1));
+    map.get(1);
+    map.get(3);
+    map.find(1);
+    map.put(3, 3);                      //  evict 2
+
+    time = std::chrono::seconds(2);
+    map.put(4, 4, std::chrono::seconds(1));
+    time = std::chrono::seconds(4);
+    map.get(4);                         //  expired
+
+    auto stats = map.stats();
+    ASSERT_EQ(stats.hits, 2u);
+    ASSERT_EQ(stats.misses, 2u);
+    ASSERT_EQ(stats.promotions, 2u);
+    ASSERT_EQ(stats.insertions, 4u);
+    ASSERT_EQ(stats.evictions, 2u);     //  2, then 1 for 4
+    ASSERT_EQ(stats.expirations, 1u);
+    ASSERT_DOUBLE_EQ(stats.hitRatio(), 0.5);
+
+    map.resetStats();
+    ASSERT_EQ(map.stats().hits, 0u);
+    ASSERT_EQ(map.stats().insertions, 0u);
+}
+
+TEST_F(EvictingCacheMapTest, StatsIndex) {
+    auto map = EvictingCacheMap<int, int>(1000);
+    for (int i = 0; i < 1000; ++i) {
+        map.put(i, i);
+    }
+    map.get(1);
+
+    auto stats = map.stats();
+    ASSERT_EQ(stats.hits, 0u);          //  not counted with NoStats
+    ASSERT_GT(stats.rehashes, 0u);
+    ASSERT_EQ(stats.indexed, 1000u);
+    ASSERT_GE(stats.averageProbeLength(), 1.0);
+    ASSERT_LT(stats.averageProbeLength(), 3.0);
+}
+
+//  loading
+
+TEST_F(EvictingCacheMapTest, GetOrCompute) {
+    auto map = EvictingCacheMap<int, int>(2);
+    int loads = 0;
+    auto loader = [&loads](int key) {
+        ++loads;
+        return key * 10;
+    };
+
+    ASSERT_EQ(map.getOrCompute(1, loader), 10);
+    ASSERT_EQ(map.getOrCompute(1, loader), 10);
+    ASSERT_EQ(loads, 1);
+
+    map.put(2, 2);
+    ASSERT_EQ(map.getOrCompute(1, loader), 10);     //  promote 1
+    map.put(3, 3);                                  //  evict 2
+    ASSERT_FALSE(map.exists(2));
+
+    ASSERT_THROW(map.getOrCompute(4, [](int) -> int {
+        throw std::runtime_error("no value");
+    }), std::runtime_error);
+    ASSERT_FALSE(map.exists(4));
+    ASSERT_EQ(map.size(), 2u);
+}
+
+//  batches
+
+TEST_F(EvictingCacheMapTest, MultiGetMatchesGet) {
+    auto batched = EvictingCacheMap<int, int>(50);
+    auto single = EvictingCacheMap<int, int>(50);
+    for (int i = 0; i < 60; ++i) {
+        batched.put(i, i * 10);
+        single.put(i, i * 10);
+    }
+
+    vector<int> keys;
+    for (int i = 0; i < 40; ++i) {
+        keys.push_back((i * 7) % 70);   //  misses below 10 and past 59
+    }
+    keys.push_back(14);                 //  duplicate
+
+    vector<std::optional<int>> values;
+    auto found = batched.multiGet(keys.begin(), keys.end(), std::back_inserter(values));
+
+    ASSERT_EQ(values.size(), keys.size());
+    size_t expectedFound = 0;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        auto expected = single.get(keys[i]);
+        ASSERT_EQ(values[i], expected);
+        expectedFound += expected.has_value();
+    }
+    ASSERT_EQ(found, expectedFound);
+
+    ASSERT_TRUE(std::equal(batched.begin(), batched.end(), single.begin(), single.end()));
+    ASSERT_EQ(batched.begin()->first, 14);
+}
+
+TEST_F(EvictingCacheMapTest, MultiPutMatchesPut) {
+    auto batched = EvictingCacheMap<int, int>(20);
+    auto single = EvictingCacheMap<int, int>(20);
+
+    vector<pair<int, int>> kvs;
+    for (int i = 0; i < 50; ++i) {
+        kvs.emplace_back((i * 3) % 35, i);
+    }
+
+    batched.multiPut(kvs.begin(), kvs.end());
+    for (auto & kv : kvs) {
+        single.put(kv.first, kv.second);
+    }
+
+    ASSERT_TRUE(std::equal(batched.begin(), batched.end(), single.begin(), single.end()));
+}
+
+TEST_F(EvictingCacheMapTest, MultiPutMoves) {
+    vector<pair<Traceable, Traceable>> kvs;
+    for (int i = 0; i < 20; ++i) {
+        kvs.emplace_back(createTraceable(), createTraceable());
+    }
+
+    vector<const Traceable::Trace *> traces;
+    for (auto & kv : kvs) {
+        traces.push_back(&kv.first.getTrace());
+        traces.push_back(&kv.second.getTrace());
+    }
+
+    auto map = EvictingCacheMap<Traceable, Traceable>(20);
+    map.multiPut(std::make_move_iterator(kvs.begin()), std::make_move_iterator(kvs.end()));
+
+    ASSERT_EQ(map.size(), 20u);
+    for (auto trace : traces) {
+        ASSERT_EQ(trace->getCopyCalls(), 0);
+    }
+}
+
+//  snapshots
+
+namespace {
+
+std::string snapshotPath(const char * name) {
+    return ::testing::TempDir() + name;
+}
+
+//  length-prefixed vector<int>, as a user serializer would be
+struct IntVectorSerializer final {
+    static void write(SnapshotWriter & out, const vector<int> & value) {
+        std::uint32_t size = static_cast<std::uint32_t>(value.size());
+        out.write(&size, sizeof(size));
+        out.write(value.data(), size * sizeof(int));
+    }
+
+    static vector<int> read(SnapshotReader & in) {
+        std::uint32_t size;
+        in.read(&size, sizeof(size));
+
+        vector<int> value(size);
+        in.read(value.data(), size * sizeof(int));
+        return value;
+    }
+};
+
+}   //  namespace
+
+TEST_F(EvictingCacheMapTest, SnapshotKeepsOrder) {
+    auto path = snapshotPath("lru_order.snapshot");
+
+    auto map = EvictingCacheMap<std::string, int>(100);
+    for (int i = 0; i < 100; ++i) {
+        map.put("key " + std::to_string(i), i);
+    }
+    map.get("key 10");
+    map.get("key 0");
+
+    map.saveSnapshot(path);
+
+    auto loaded = EvictingCacheMap<std::string, int>(100);
+    loaded.put("stale", -1);
+    auto rehashes = loaded.stats().rehashes;
+    loaded.loadSnapshot(path);
+
+    ASSERT_FALSE(loaded.exists("stale"));
+    ASSERT_TRUE(std::equal(loaded.begin(), loaded.end(), map.begin(), map.end()));
+    ASSERT_LE(loaded.stats().rehashes - rehashes, 1u);     //  the reserve
+
+    loaded.put("new", 1);                       //  evicts the same entry as map
+    map.put("new", 1);
+    ASSERT_TRUE(std::equal(loaded.begin(), loaded.end(), map.begin(), map.end()));
+
+    std::remove(path.c_str());
+}
+
+TEST_F(EvictingCacheMapTest, SnapshotOverCapacity) {
+    auto path = snapshotPath("lru_capacity.snapshot");
+
+    auto map = EvictingCacheMap<int, double>(10);
+    for (int i = 0; i < 10; ++i) {
+        map.put(i, i * 0.5);
+    }
+    map.saveSnapshot(path);
+
+    auto small = EvictingCacheMap<int, double>(4);
+    small.loadSnapshot(path);
+
+    vector<int> keys;
+    for (auto & kv : small) {
+        keys.push_back(kv.first);
+    }
+    ASSERT_THAT(keys, ::testing::ElementsAre(9, 8, 7, 6));
+    ASSERT_EQ(*small.peek(7), 3.5);
+
+    std::remove(path.c_str());
+}
+
+TEST_F(EvictingCacheMapTest, SnapshotOverWeight) {
+    auto path = snapshotPath("lru_weight.snapshot");
+
+    auto map = WeightedMap(10, 100);
+    map.put(1, std::string(30, 'a'));
+    map.put(2, std::string(30, 'b'));
+    map.put(3, std::string(30, 'c'));
+    map.saveSnapshot(path);
+
+    auto light = WeightedMap(10, 70);
+    light.loadSnapshot(path);
+    ASSERT_FALSE(light.exists(1));
+    ASSERT_TRUE(light.exists(2));
+    ASSERT_TRUE(light.exists(3));
+    ASSERT_EQ(light.totalWeight(), 60u);
+
+    std::remove(path.c_str());
+}
+
+TEST_F(EvictingCacheMapTest, SnapshotCustomSerializer) {
+    auto path = snapshotPath("lru_custom.snapshot");
+
+    auto map = EvictingCacheMap<int, vector<int>>(3);
+    map.put(1, vector<int>{ 1 });
+    map.put(2, vector<int>{});
+    map.put(3, vector<int>{ 3, 4, 5 });
+    map.saveSnapshot<Serializer<int>, IntVectorSerializer>(path);
+
+    auto loaded = EvictingCacheMap<int, vector<int>>(3);
+    loaded.loadSnapshot<Serializer<int>, IntVectorSerializer>(path);
+    ASSERT_TRUE(std::equal(loaded.begin(), loaded.end(), map.begin(), map.end()));
+
+    std::remove(path.c_str());
+}
+
+TEST_F(EvictingCacheMapTest, SnapshotSkipsExpired) {
+    auto path = snapshotPath("lru_expired.snapshot");
+    auto time = std::chrono::nanoseconds(0);
+
+    auto map = expiringMap(4, time);
+    map.put(1, 1);
+    map.put(2, 2, std::chrono::seconds(1));
+    time = std::chrono::seconds(2);
+    map.saveSnapshot(path);
+
+    auto loaded = EvictingCacheMap<int, int>(4);
+    loaded.loadSnapshot(path);
+    ASSERT_EQ(loaded.size(), 1u);
+    ASSERT_TRUE(loaded.exists(1));
+
+    std::remove(path.c_str());
+}
+
+TEST_F(EvictingCacheMapTest, SnapshotInvalid) {
+    auto map = EvictingCacheMap<int, int>(4);
+    ASSERT_THROW(map.loadSnapshot(snapshotPath("lru_missing.snapshot")), std::system_error);
+
+    auto path = snapshotPath("lru_invalid.snapshot");
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << "not a snapshot, but long enough for a header";
+    }
+    ASSERT_THROW(map.loadSnapshot(path), std::runtime_error);
+
+    map.put(1, 1);
+    map.put(2, 2);
+    map.saveSnapshot(path);
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+    ASSERT_THROW(map.loadSnapshot(path), std::runtime_error);
+    ASSERT_TRUE(map.empty());
+
+    {
+        SnapshotHeader header{};
+        std::memcpy(header.magic, SnapshotHeader::MAGIC, sizeof(header.magic));
+        header.version = SnapshotHeader::VERSION;
+        header.byteOrder = SnapshotHeader::BYTE_ORDER_MARK;
+        header.count = 3;
+
+        SnapshotWriter out(path);
+        out.write(&header, sizeof(header));
+        for (int kv : { 1, 2, 1 }) {
+            out.write(&kv, sizeof(kv));
+            out.write(&kv, sizeof(kv));
+        }
+        out.close();
+    }
+    ASSERT_THROW(map.loadSnapshot(path), std::runtime_error);
+    ASSERT_TRUE(map.empty());
+
+    std::remove(path.c_str());
+}
+
+//  stored hashes
+
+static_assert(StoreHash<std::string, std::hash<std::string>>::value);
+static_assert(!StoreHash<int, std::hash<int>>::value);
+static_assert(!StoreHash<const char *, std::hash<const char *>>::value);
+
+struct CountingStringHash {
+    size_t * calls = nullptr;
+
+    size_t operator()(const std::string & key) const {
+        ++*calls;
+        return std::hash<std::string>()(key);
+    }
+};
+
+TEST_F(EvictingCacheMapTest, StoredHashOncePerCall) {
+    size_t calls = 0;
+    auto map = EvictingCacheMap<std::string, int, CountingStringHash>(1000, CountingStringHash{ &calls });
+
+    //  growth of the index and evictions do not hash the keys again
+    for (int i = 0; i < 3000; ++i) {
+        map.put(std::to_string(i), i);
+    }
+    map.max_load_factor(map.max_load_factor() / 4);
+    ASSERT_EQ(calls, 3000u);
+
+    //  neither do erasures and copies
+    ASSERT_TRUE(map.erase("2500"));
+    ASSERT_FALSE(map.erase("10"));
+    auto copy = map;
+    copy.shrink_to_fit();
+    ASSERT_EQ(calls, 3002u);
+
+    ASSERT_EQ(copy.size(), 999u);
+    ASSERT_EQ(copy.get("2999").value(), 2999);
+    ASSERT_FALSE(copy.exists("2500"));
+}
+
+TEST_F(EvictingCacheMapTest, StoredHashCollisions) {
+    auto map = EvictingCacheMap<std::string, int, BadHash<std::string>>(10);
+    for (int i = 0; i < 20; ++i) {
+        map.put(std::to_string(i), i);
+    }
+
+    for (int i = 0; i < 20; ++i) {
+        ASSERT_EQ(map.exists(std::to_string(i)), i >= 10) << i;
+    }
+
+    ASSERT_TRUE(map.erase("15"));
+    ASSERT_EQ(map.get("16").value(), 16);
+    ASSERT_EQ(map.size(), 9u);
+}
+
+//  allocators
+
+struct AllocationCounts {
+    size_t allocations = 0;
+    size_t deallocations = 0;
+};
+
+template <class T>
+struct CountingAllocator {
+    using value_type = T;
+
+    AllocationCounts * counts;
+
+    explicit CountingAllocator(AllocationCounts * counts) noexcept
+            : counts(counts) {
+    }
+
+    template <class U>
+    CountingAllocator(const CountingAllocator<U> & other) noexcept
+            : counts(other.counts) {
+    }
+
+    T * allocate(size_t n) {
+        ++counts->allocations;
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T * p, size_t n) noexcept {
+        ++counts->deallocations;
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <class U>
+    friend bool operator==(const CountingAllocator & a, const CountingAllocator<U> & b) noexcept {
+        return a.counts == b.counts;
+    }
+
+    template <class U>
+    friend bool operator!=(const CountingAllocator & a, const CountingAllocator<U> & b) noexcept {
+        return a.counts != b.counts;
+    }
+};
+
+using AllocatingMap = EvictingCacheMap<int, int, std::hash<int>, LruPolicy, UnitWeigher,
+        std::chrono::steady_clock, NoStats, CountingAllocator<std::pair<const int, int>>>;
+
+TEST_F(EvictingCacheMapTest, AllocatorSteadyState) {
+    AllocationCounts counts;
+    auto map = AllocatingMap(1000, CountingAllocator<std::pair<const int, int>>(&counts));
+    for (int i = 0; i < 1000; ++i) {
+        map.put(i, i);
+    }
+    ASSERT_GT(counts.allocations, 0u);
+    ASSERT_TRUE(map.get_allocator() == CountingAllocator<int>(&counts));
+
+    //  a full map reuses its slots and buckets; only the index allocates,
+    //  once in many evictions, for a table of the same size without the
+    //  deleted buckets
+    auto allocations = counts.allocations;
+    auto rehashes = map.stats().rehashes;
+    for (int i = 1000; i < 20000; ++i) {
+        map.put(i, i);
+        if (i % 3 == 0)
+            map.erase(i - 500);
+        map.get(i - 100);
+    }
+    ASSERT_EQ(counts.allocations - allocations, map.stats().rehashes - rehashes);
+    ASSERT_LE(counts.allocations - allocations, 4u);
+    ASSERT_EQ(map.get(19999).value(), 19999);
+}
+
+TEST_F(EvictingCacheMapTest, AllocatorMove) {
+    AllocationCounts first;
+    AllocationCounts second;
+    auto a = AllocatingMap(100, CountingAllocator<std::pair<const int, int>>(&first));
+    auto b = AllocatingMap(100, CountingAllocator<std::pair<const int, int>>(&second));
+    for (int i = 0; i < 150; ++i) {
+        a.put(i, i);
+    }
+    a.get(60);
+
+    //  the storage of a cannot go to b: the entries move one by one
+    auto allocations = first.allocations;
+    b = std::move(a);
+    ASSERT_TRUE(a.empty());
+    ASSERT_EQ(first.allocations, allocations);
+    ASSERT_GT(second.allocations, 0u);
+    ASSERT_EQ(b.size(), 100u);
+    ASSERT_EQ(b.begin()->first, 60);
+    ASSERT_EQ(std::prev(b.end())->first, 50);
+
+    //  a move construction takes the allocator and the storage
+    allocations = second.allocations;
+    auto c = std::move(b);
+    ASSERT_EQ(second.allocations, allocations);
+    ASSERT_TRUE(c.get_allocator() == CountingAllocator<int>(&second));
+    ASSERT_EQ(c.size(), 100u);
+    ASSERT_EQ(c.get(99).value(), 99);
+
+    auto d = c;
+    ASSERT_TRUE(d.get_allocator() == CountingAllocator<int>(&second));
+    ASSERT_THAT(d, ::testing::ElementsAreArray(c.begin(), c.end()));
+}
+
+#ifdef LRU_HAS_PMR
+//  memory resource counting the calls which reach it
+struct CountingResource final : std::pmr::memory_resource {
+    size_t allocations = 0;
+
+    void * do_allocate(size_t bytes, size_t alignment) override {
+        ++allocations;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void * p, size_t bytes, size_t alignment) override {
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource & other) const noexcept override {
+        return this == &other;
+    }
+};
+
+static std::pmr::string pmrKey(int i, std::pmr::memory_resource * resource) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "session:%016x", static_cast<unsigned>(i));
+    return std::pmr::string(buffer, resource);
+}
+
+TEST_F(EvictingCacheMapTest, PmrKeysUseResource) {
+    CountingResource resource;
+    auto map = PmrEvictingCacheMap<std::pmr::string, std::pmr::string>(10, &resource);
+
+    //  keys and values made elsewhere are copied into the resource of the map
+    map.put(pmrKey(1, std::pmr::new_delete_resource()), std::pmr::string(100, 'a'));
+    map.try_emplace(pmrKey(2, std::pmr::new_delete_resource()), 100, 'b');
+
+    for (auto & kv : map) {
+        ASSERT_EQ(kv.first.get_allocator().resource(), &resource);
+        ASSERT_EQ(kv.second.get_allocator().resource(), &resource);
+    }
+    ASSERT_EQ(map.get_allocator().resource(), &resource);
+    ASSERT_GE(resource.allocations, 4u);
+}
+
+TEST_F(EvictingCacheMapTest, PmrPoolSteadyState) {
+    CountingResource upstream;
+    std::pmr::unsynchronized_pool_resource pool(&upstream);
+    auto map = PmrEvictingCacheMap<std::pmr::string, int>(1000, &pool);
+
+    for (int i = 0; i < 2000; ++i) {
+        map.put(pmrKey(i, &pool), i);
+    }
+
+    //  evicted keys give their blocks back to the pool for the new ones
+    auto allocations = upstream.allocations;
+    for (int i = 2000; i < 20000; ++i) {
+        map.put(pmrKey(i, &pool), i);
+    }
+    ASSERT_EQ(upstream.allocations, allocations);
+    ASSERT_EQ(map.get(pmrKey(19999, &pool)).value(), 19999);
+}
+#endif
+
+//  full puts
+
+struct Brittle {
+    int v;
+
+    Brittle(int v) : v(v) {
+    }
+
+    Brittle(const Brittle &) = default;
+
+    //  not trivial, so that a full put assigns over the victim
+    ~Brittle() {
+    }
+
+    Brittle & operator=(const Brittle & other) {
+        if (other.v < 0)
+            throw std::runtime_error("cannot assign");
+
+        v = other.v;
+        return *this;
+    }
+};
+
+TEST_F(EvictingCacheMapTest, FullPutAssignThrows) {
+    auto map = EvictingCacheMap<int, Brittle>(2);
+    map.put(1, Brittle(1));
+    map.put(2, Brittle(2));
+
+    //  the victim is gone, the new entry never was
+    const Brittle bad(-1);
+    ASSERT_THROW(map.put(3, bad), std::runtime_error);
+    ASSERT_EQ(map.size(), 1u);
+    ASSERT_FALSE(map.exists(1));
+    ASSERT_FALSE(map.exists(3));
+
+    const Brittle good(4);
+    map.put(4, good);
+    map.put(5, good);
+    ASSERT_EQ(map.size(), 2u);
+    ASSERT_FALSE(map.exists(2));
+    ASSERT_EQ(map.get(5)->v, 4);
+}
+
+TEST_F(EvictingCacheMapTest, FullPutKeepsBuffers) {
+    auto map = EvictingCacheMap<std::string, std::string>(100);
+    for (int i = 0; i < 100; ++i) {
+        map.put(std::to_string(i), std::string(64, 'a'));
+    }
+
+    //  the new key and value are copied into those of the victim
+    for (int i = 100; i < 1000; ++i) {
+        auto & victim = *std::prev(map.end());
+        auto buffer = victim.second.data();
+
+        const std::string key = std::to_string(i);
+        const std::string value(64, 'b');
+        map.put(key, value);
+
+        ASSERT_EQ(map.find(key)->second.data(), buffer);
+    }
+    ASSERT_EQ(map.size(), 100u);
+    ASSERT_FALSE(map.exists("899"));
+    ASSERT_EQ(*map.get("999"), std::string(64, 'b'));
+}
+
+//  structural copy, merge and capacity
+
+TEST_F(EvictingCacheMapTest, CopyWithoutLookups) {
+    size_t calls = 0;
+    auto map = EvictingCacheMap<std::string, int, CountingStringHash>(100, CountingStringHash{ &calls });
+    for (int i = 0; i < 150; ++i) {
+        map.put(std::to_string(i), i);
+    }
+    map.erase("120");
+    map.get("60");
+    calls = 0;
+
+    auto copy = map;
+    ASSERT_EQ(calls, 0u);
+    ASSERT_THAT(copy, ::testing::ElementsAreArray(map.begin(), map.end()));
+    ASSERT_EQ(copy.bucket_count(), map.bucket_count());
+
+    //  the copy goes on as the original would, freed slot included
+    copy.put("a", -1);
+    map.put("a", -1);
+    copy.put("b", -2);
+    map.put("b", -2);
+    ASSERT_THAT(copy, ::testing::ElementsAreArray(map.begin(), map.end()));
+}
+
+TEST_F(EvictingCacheMapTest, CopyDropsExpired) {
+    using namespace std::chrono_literals;
+
+    auto time = std::chrono::nanoseconds(1h);
+    auto map = expiringMap(10, time);
+    map.put(1, 1, 10s);
+    map.put(2, 2, 1h);
+    map.put(3, 3);
+
+    size_t notified = 0;
+    map.setRemovalListener([&notified](pair<int, int> &&, RemovalCause) {
+        ++notified;
+    });
+
+    time += 20s;
+    auto copy = map;
+    ASSERT_EQ(copy.size(), 2u);
+    ASSERT_FALSE(copy.exists(1));
+    ASSERT_EQ(notified, 0u);
+
+    time += 1h;
+    ASSERT_FALSE(copy.exists(2));
+    ASSERT_EQ(copy.get(3).value(), 3);
+}
+
+TEST_F(EvictingCacheMapTest, CopyKeepsOwnListener) {
+    auto map = EvictingCacheMap<int, int>(2);
+    vector<int> fromMap;
+    map.setRemovalListener([&fromMap](pair<int, int> && kv, RemovalCause) {
+        fromMap.push_back(kv.first);
+    });
+    map.put(1, 1);
+    map.put(2, 2);
+
+    //  a copy has no listener
+    auto copy = map;
+    copy.put(3, 3);
+    ASSERT_TRUE(fromMap.empty());
+
+    //  an assigned map keeps its own
+    vector<int> fromCopy;
+    copy.setRemovalListener([&fromCopy](pair<int, int> && kv, RemovalCause) {
+        fromCopy.push_back(kv.first);
+    });
+    copy = map;
+    copy.put(4, 4);
+    ASSERT_TRUE(fromMap.empty());
+    ASSERT_EQ(fromCopy, vector<int>{ 1 });
+}
+
+TEST_F(EvictingCacheMapTest, Merge) {
+    auto map = EvictingCacheMap<int, int>(5);
+    for (int i = 0; i < 4; ++i) {
+        map.put(i, i);
+    }
+
+    auto other = EvictingCacheMap<int, int>(10);
+    other.put(2, 20);
+    other.put(4, 40);
+    other.put(5, 50);
+    other.get(2);
+
+    //  the entries of other, most recent first, then those of map; 0 evicted
+    map.merge(other);
+    ASSERT_EQ(other.size(), 3u);
+    ASSERT_THAT(map, ::testing::ElementsAre(pair<const int, int>(2, 20), pair<const int, int>(5, 50),
+                                            pair<const int, int>(4, 40), pair<const int, int>(3, 3),
+                                            pair<const int, int>(1, 1)));
+
+    auto strings = EvictingCacheMap<std::string, std::string>(10);
+    auto source = EvictingCacheMap<std::string, std::string>(10);
+    source.put("k", std::string(100, 'v'));
+    auto buffer = source.find("k")->second.data();
+    strings.merge(std::move(source));
+    ASSERT_TRUE(source.empty());
+    ASSERT_EQ(strings.find("k")->second.data(), buffer);
+
+    map.merge(map);
+    ASSERT_EQ(map.size(), 5u);
+}
+
+TEST_F(EvictingCacheMapTest, MergeKeepsExpiry) {
+    using namespace std::chrono_literals;
+
+    auto time = std::chrono::nanoseconds(1h);
+    auto map = expiringMap(10, time);
+    auto other = expiringMap(10, time);
+    other.put(1, 1, 10s);
+    other.put(2, 2, 1s);
+    other.put(3, 3);
+
+    time += 5s;
+    map.merge(other);
+    ASSERT_EQ(map.size(), 2u);
+    ASSERT_FALSE(map.exists(2));
+
+    time += 5s;
+    ASSERT_FALSE(map.exists(1));
+    ASSERT_TRUE(map.exists(3));
+}
+
+TEST_F(EvictingCacheMapTest, SetCapacity) {
+    auto map = EvictingCacheMap<int, int>(100);
+    for (int i = 0; i < 100; ++i) {
+        map.put(i, i);
+    }
+    map.get(10);
+
+    vector<int> evicted;
+    map.setRemovalListener([&evicted](pair<int, int> && kv, RemovalCause cause) {
+        ASSERT_EQ(cause, RemovalCause::EVICTED);
+        evicted.push_back(kv.first);
+    });
+
+    //  the least recently used go, 10 stays
+    map.setCapacity(20);
+    ASSERT_EQ(map.getCapacity(), 20u);
+    ASSERT_EQ(map.size(), 20u);
+    ASSERT_EQ(evicted.size(), 80u);
+    ASSERT_EQ(evicted.front(), 0);
+    ASSERT_EQ(evicted.back(), 80);
+    ASSERT_TRUE(map.exists(10));
+
+    map.put(100, 100);
+    ASSERT_EQ(map.size(), 20u);
+    ASSERT_FALSE(map.exists(81));
+
+    map.setCapacity(200);
+    for (int i = 1000; i < 1300; ++i) {
+        map.put(i, i);
+    }
+    ASSERT_EQ(map.size(), 200u);
+
+    map.setCapacity(150);
+    ASSERT_EQ(map.size(), 150u);
+    ASSERT_FALSE(map.exists(1149));
+    ASSERT_TRUE(map.exists(1150));
+
+    map.setCapacity(0);
+    ASSERT_TRUE(map.empty());
+    map.put(1, 1);
+    ASSERT_TRUE(map.empty());
+
+    ASSERT_THROW(map.setCapacity(SIZE_MAX), std::length_error);
+}
@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <EvictingCacheMap.h>
+
+using std::size_t;
+using std::vector;
+
+template <class TPolicy>
+using PolicyMap = EvictingCacheMap<int, int, std::hash<int>, TPolicy>;
+
+/**
+ * Put a key in the map if a get() misses, as a cache user would
+ */
+template <class TMap>
+static void access(TMap & map, int key) {
+    if (!map.get(key).has_value())
+        map.put(key, key);
+}
+
+/**
+ * Number of hot keys which survive a scan of new keys, after a warm-up
+ *     which interleaves the hot keys with cold ones
+ */
+template <class TPolicy>
+static int hotAfterScan() {
+    auto map = PolicyMap<TPolicy>(100);
+
+    int cold = 1000;
+    for (int round = 0; round < 20; ++round) {
+        for (int hot = 0; hot < 10; ++hot) {
+            access(map, hot);
+        }
+
+        for (int i = 0; i < 50; ++i) {
+            access(map, cold++);
+        }
+    }
+
+    for (int i = 0; i < 1000; ++i) {
+        access(map, cold++);
+    }
+
+    int survivors = 0;
+    for (int hot = 0; hot < 10; ++hot) {
+        survivors += map.exists(hot);
+    }
+
+    return survivors;
+}
+
+//  common invariants
+
+template <class TPolicy>
+class EvictionPolicyTest : public ::testing::Test {
+};
+
+using Policies = ::testing::Types<LruPolicy, ClockPolicy, SlruPolicy, TwoQueuePolicy, ArcPolicy,
+        WTinyLfuPolicy>;
+TYPED_TEST_SUITE(EvictionPolicyTest, Policies);
+
+TYPED_TEST(EvictionPolicyTest, Invariants) {
+    const size_t capacity = 50;
+    auto map = PolicyMap<TypeParam>(capacity);
+
+    unsigned seed = 4321;
+    for (int i = 0; i < 20000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        int key = static_cast<int>((seed >> 16) % 150);
+
+        switch ((seed >> 8) % 8) {
+            case 0:
+                map.erase(key);
+                ASSERT_FALSE(map.exists(key));
+                break;
+            case 1:
+            case 2:
+            case 3: {
+                auto value = map.get(key);
+                ASSERT_EQ(value.has_value(), map.exists(key));
+                if (value) {
+                    ASSERT_EQ(*value, key * 3);
+                }
+                break;
+            }
+            default:
+                map.put(key, key * 3);
+                ASSERT_TRUE(map.exists(key));
+        }
+
+        if (i % 5000 == 4999)
+            map.shrink_to_fit();
+
+        ASSERT_LE(map.size(), capacity);
+
+        size_t walked = 0;
+        for (auto & kv : map) {
+            ASSERT_EQ(kv.second, kv.first * 3);
+            ++walked;
+        }
+        ASSERT_EQ(walked, map.size());
+    }
+
+    map.clear();
+    ASSERT_TRUE(map.empty());
+
+    map.put(1, 3);
+    ASSERT_EQ(map.get(1).value(), 3);
+}
+
+TYPED_TEST(EvictionPolicyTest, CapacityOne) {
+    auto map = PolicyMap<TypeParam>(1);
+    for (int i = 0; i < 10; ++i) {
+        map.put(i, i * 3);
+        map.get(i);
+        ASSERT_EQ(map.size(), 1u);
+        ASSERT_EQ(map.begin()->first, i);
+    }
+}
+
+TYPED_TEST(EvictionPolicyTest, Copy) {
+    auto map = PolicyMap<TypeParam>(10);
+    for (int i = 0; i < 30; ++i) {
+        access(map, i % 13);
+    }
+
+    auto copy = map;
+    ASSERT_EQ(copy.size(), map.size());
+    for (auto & kv : map) {
+        ASSERT_EQ(copy.get(kv.first).value(), kv.second);
+    }
+}
+
+TYPED_TEST(EvictionPolicyTest, CopyKeepsState) {
+    auto map = PolicyMap<TypeParam>(50);
+    unsigned seed = 99;
+    auto next = [&seed]() {
+        seed = seed * 1103515245 + 12345;
+        return static_cast<int>((seed >> 16) % 150);
+    };
+
+    for (int i = 0; i < 5000; ++i) {
+        access(map, next() % (i % 3 == 0 ? 150 : 40));
+    }
+
+    //  the copy evicts exactly as the original from then on
+    auto copy = map;
+    for (int i = 0; i < 5000; ++i) {
+        auto key = next();
+        access(map, key);
+        access(copy, key);
+    }
+
+    ASSERT_TRUE(std::equal(map.begin(), map.end(), copy.begin(), copy.end()));
+}
+
+TYPED_TEST(EvictionPolicyTest, SetCapacity) {
+    auto map = PolicyMap<TypeParam>(100);
+    for (int i = 0; i < 1000; ++i) {
+        access(map, i % 150);
+    }
+
+    map.setCapacity(30);
+    ASSERT_EQ(map.size(), 30u);
+    for (int i = 0; i < 1000; ++i) {
+        access(map, i % 50);
+        ASSERT_LE(map.size(), 30u);
+    }
+
+    map.setCapacity(60);
+    for (int i = 0; i < 1000; ++i) {
+        access(map, i % 80);
+    }
+    ASSERT_EQ(map.size(), 60u);
+}
+
+//  LRU
+
+TEST(LruPolicyTest, ScanFlushesHotKeys) {
+    ASSERT_EQ(hotAfterScan<LruPolicy>(), 0);
+}
+
+//  CLOCK
+
+TEST(ClockPolicyTest, HitDoesNotRelink) {
+    auto map = PolicyMap<ClockPolicy>(3);
+    map.put(1, 1);
+    map.put(2, 2);
+    map.put(3, 3);
+
+    auto before = vector<int>();
+    for (auto & kv : map) {
+        before.push_back(kv.first);
+    }
+
+    map.get(1);
+    map.get(3);
+
+    auto after = vector<int>();
+    for (auto & kv : map) {
+        after.push_back(kv.first);
+    }
+
+    ASSERT_EQ(before, after);
+}
+
+TEST(ClockPolicyTest, SecondChance) {
+    auto map = PolicyMap<ClockPolicy>(3);
+    map.put(1, 1);
+    map.put(2, 2);
+    map.put(3, 3);
+
+    map.get(1);     //  referenced: survives one sweep
+    map.put(4, 4);  //  evict {2, 2}
+
+    ASSERT_TRUE(map.exists(1));
+    ASSERT_FALSE(map.exists(2));
+    ASSERT_TRUE(map.exists(3));
+    ASSERT_TRUE(map.exists(4));
+
+    map.put(5, 5);  //  evict {3, 3}; 1 lost its bit on the previous sweep
+    ASSERT_FALSE(map.exists(3));
+    ASSERT_TRUE(map.exists(1));
+
+    map.put(6, 6);  //  evict {1, 1}
+    ASSERT_FALSE(map.exists(1));
+}
+
+//  scan resistance
+
+TEST(SlruPolicyTest, ScanResistance) {
+    ASSERT_EQ(hotAfterScan<SlruPolicy>(), 10);
+}
+
+TEST(TwoQueuePolicyTest, ScanResistance) {
+    ASSERT_EQ(hotAfterScan<TwoQueuePolicy>(), 10);
+}
+
+TEST(ArcPolicyTest, ScanResistance) {
+    ASSERT_EQ(hotAfterScan<ArcPolicy>(), 10);
+}
+
+TEST(WTinyLfuPolicyTest, ScanResistance) {
+    ASSERT_EQ(hotAfterScan<WTinyLfuPolicy>(), 10);
+}
+
+TEST(TwoQueuePolicyTest, GhostPromotesToMain) {
+    auto map = PolicyMap<TwoQueuePolicy>(4);
+    for (int i = 0; i < 5; ++i) {
+        map.put(i, i);  //  the fifth put evicts {0, 0} into the ghost list
+    }
+    ASSERT_FALSE(map.exists(0));
+
+    map.put(0, 0);      //  back from the ghost list: main queue head
+    ASSERT_EQ(map.begin()->first, 0);
+
+    for (int i = 10; i < 20; ++i) {
+        map.put(i, i);  //  the FIFO keeps being evicted first
+    }
+    ASSERT_TRUE(map.exists(0));
+}
+
+TEST(ArcPolicyTest, Adapts) {
+    auto map = PolicyMap<ArcPolicy>(10);
+    for (int i = 0; i < 10; ++i) {
+        map.put(i, i);
+    }
+    for (int i = 0; i < 5; ++i) {
+        map.get(i);     //  T2
+    }
+    for (int i = 10; i < 15; ++i) {
+        map.put(i, i);  //  evict 5..9 from T1 into B1
+    }
+
+    ASSERT_EQ(map.getPolicy().getTarget(), 0u);
+
+    map.put(5, 5);      //  B1 hit: recency deserves more room
+    ASSERT_GT(map.getPolicy().getTarget(), 0u);
+}
+
+//  W-TinyLFU
+
+/**
+ * Hits of a skewed workload: half of the accesses go to 200 popular keys,
+ *     the other half to keys which are seldom seen twice
+ */
+template <class TPolicy>
+static int skewedHits() {
+    auto map = PolicyMap<TPolicy>(100);
+
+    int hits = 0;
+    unsigned seed = 99;
+    for (int i = 0; i < 100000; ++i) {
+        seed = seed * 1103515245 + 12345;
+        auto r = (seed >> 8) % 100000;
+        int key = (r % 2 == 0) ? static_cast<int>(r / 2 % 1000 * (r / 2 % 1000) / 5000)
+                               : static_cast<int>(1000 + r);
+
+        if (map.get(key).has_value())
+            ++hits;
+        else
+            map.put(key, key);
+    }
+
+    return hits;
+}
+
+TEST(WTinyLfuPolicyTest, BeatsLruOnSkewedWorkload) {
+    ASSERT_GT(skewedHits<WTinyLfuPolicy>(), skewedHits<LruPolicy>() * 3 / 2);
+}
+
+TEST(WTinyLfuPolicyTest, RejectsOneHitWonder) {
+    auto map = PolicyMap<WTinyLfuPolicy>(10);
+    for (int i = 0; i < 10; ++i) {
+        map.put(i, i);
+        map.get(i);
+        map.get(i);
+    }
+
+    map.put(100, 100);  //  enters the window, pushing {9, 9} out
+    map.put(101, 101);  //  pushes {100, 100} out: seen once, it loses
+
+    ASSERT_FALSE(map.exists(100));
+    ASSERT_TRUE(map.exists(101));
+    for (int i = 0; i < 9; ++i) {
+        ASSERT_TRUE(map.exists(i));
+    }
+}
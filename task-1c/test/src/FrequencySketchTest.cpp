@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+
+#include <FrequencySketch.h>
+
+using std::size_t;
+
+TEST(FrequencySketchTest, Count) {
+    FrequencySketch sketch;
+    sketch.setSize(64);
+
+    ASSERT_EQ(sketch.frequency(1), 0);
+
+    for (int i = 0; i < 5; ++i) {
+        sketch.increment(1);
+    }
+    sketch.increment(2);
+
+    ASSERT_EQ(sketch.frequency(1), 5);
+    ASSERT_EQ(sketch.frequency(2), 1);
+}
+
+TEST(FrequencySketchTest, Saturates) {
+    FrequencySketch sketch;
+    sketch.setSize(64);
+
+    for (int i = 0; i < 100; ++i) {
+        sketch.increment(7);
+    }
+
+    ASSERT_EQ(sketch.frequency(7), FrequencySketch::MAX_FREQUENCY);
+}
+
+TEST(FrequencySketchTest, NeverUnderestimates) {
+    FrequencySketch sketch;
+    sketch.setSize(32);
+
+    //  far more keys than words, but too few increments to age them:
+    //  collisions only add up
+    for (size_t key = 0; key < 200; ++key) {
+        for (size_t i = 0; i < key % 4; ++i) {
+            sketch.increment(key);
+        }
+    }
+
+    for (size_t key = 0; key < 200; ++key) {
+        ASSERT_GE(sketch.frequency(key), key % 4);
+    }
+}
+
+TEST(FrequencySketchTest, Aging) {
+    FrequencySketch sketch;
+    sketch.setSize(64);
+
+    for (int i = 0; i < 12; ++i) {
+        sketch.increment(3);
+    }
+    ASSERT_EQ(sketch.frequency(3), 12);
+
+    sketch.reset();
+    ASSERT_EQ(sketch.frequency(3), 6);
+
+    //  the sample size is 640 increments: other keys age the old ones out
+    for (size_t key = 1000; key < 3000; ++key) {
+        sketch.increment(key);
+    }
+    ASSERT_LE(sketch.frequency(3), 3);
+}
+
+TEST(FrequencySketchTest, Clear) {
+    FrequencySketch sketch;
+    sketch.setSize(8);
+
+    sketch.increment(5);
+    sketch.clear();
+
+    ASSERT_EQ(sketch.frequency(5), 0);
+}
@@ -0,0 +1,95 @@
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <EvictingCacheMap.h>
+#include <MissRatioCurve.h>
+
+namespace {
+
+//  keys of a skewed trace: the square of a uniform variable favours small keys
+std::vector<std::uint64_t> skewedTrace(std::size_t length, std::uint64_t keys, unsigned seed) {
+    std::mt19937_64 random(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+    std::vector<std::uint64_t> result(length);
+    for (auto & key : result) {
+        auto u = uniform(random);
+        key = static_cast<std::uint64_t>(u * u * keys);
+    }
+
+    return result;
+}
+
+std::uint64_t replayMisses(const std::vector<std::uint64_t> & trace, std::size_t capacity) {
+    EvictingCacheMap<std::uint64_t, char> map(capacity);
+
+    std::uint64_t misses = 0;
+    for (auto key : trace) {
+        if (map.find(key) == map.end()) {
+            ++misses;
+            map.put(key, 0);
+        }
+    }
+
+    return misses;
+}
+
+}   //  namespace
+
+TEST(MissRatioCurveTest, StackDistances) {
+    MissRatioCurve curve;
+    ASSERT_EQ(curve.missRatio(4), 0.0);
+
+    //  a b c a b d a: a and b come back at distance 3, a again at 3
+    for (std::uint64_t key : { 1, 2, 3, 1, 2, 4, 1 }) {
+        curve.access(key);
+    }
+
+    ASSERT_EQ(curve.accesses(), 7u);
+    ASSERT_EQ(curve.distinctKeys(), 4u);
+    ASSERT_DOUBLE_EQ(curve.misses(0), 7.0);
+    ASSERT_DOUBLE_EQ(curve.misses(2), 7.0);
+    ASSERT_DOUBLE_EQ(curve.misses(3), 4.0);
+    ASSERT_DOUBLE_EQ(curve.misses(100), 4.0);
+}
+
+TEST(MissRatioCurveTest, MatchesReplay) {
+    //  long enough for the tree to be compacted many times
+    auto trace = skewedTrace(400000, 5000, 1);
+
+    MissRatioCurve curve;
+    for (auto key : trace) {
+        curve.access(key);
+    }
+
+    for (std::size_t capacity : { 1, 10, 100, 1000, 4000, 10000 }) {
+        ASSERT_DOUBLE_EQ(curve.misses(capacity), replayMisses(trace, capacity)) << capacity;
+    }
+}
+
+TEST(MissRatioCurveTest, Sampled) {
+    auto trace = skewedTrace(400000, 50000, 2);
+
+    MissRatioCurve exact;
+    MissRatioCurve sampled(0.1);
+    for (auto key : trace) {
+        exact.access(key);
+        sampled.access(key);
+    }
+
+    ASSERT_NEAR(sampled.rate(), 0.1, 1e-6);
+    ASSERT_NEAR(static_cast<double>(sampled.distinctKeys()), exact.distinctKeys(), 0.05 * exact.distinctKeys());
+
+    for (std::size_t capacity : { 1000, 5000, 20000, 40000 }) {
+        ASSERT_NEAR(sampled.missRatio(capacity), exact.missRatio(capacity), 0.02) << capacity;
+    }
+}
+
+TEST(MissRatioCurveTest, InvalidRate) {
+    ASSERT_THROW(MissRatioCurve(0.0), std::invalid_argument);
+    ASSERT_THROW(MissRatioCurve(1.5), std::invalid_argument);
+}
@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <EvictingCacheMap.h>
+#include <StaticEvictingCacheMap.h>
+
+using std::pair;
+using std::string;
+using std::vector;
+
+//  maps of trivial entries are literal types, built at compile time
+static_assert(std::is_trivially_destructible<StaticEvictingCacheMap<int, int, 8>>::value, "");
+static_assert(std::is_trivially_destructible<StaticEvictingCacheMap<int, int, 64>>::value, "");
+static_assert(!std::is_trivially_destructible<StaticEvictingCacheMap<string, int, 8>>::value, "");
+
+static constexpr StaticEvictingCacheMap<int, int, 300> CONSTANT_MAP;
+static_assert(CONSTANT_MAP.empty(), "");
+static_assert(StaticEvictingCacheMap<int, int, 300>::capacity() == 300, "");
+
+static_assert(!StaticEvictingCacheMap<int, int, 8>::HASHED, "");
+static_assert(StaticEvictingCacheMap<int, int, 9>::HASHED, "");
+
+template <class TMap>
+static vector<pair<int, int>> entries(const TMap & map) {
+    return vector<pair<int, int>>(map.begin(), map.end());
+}
+
+template <std::size_t N>
+static void checkLruOrder() {
+    StaticEvictingCacheMap<int, int, N> map;
+    for (int i = 0; i < static_cast<int>(N); ++i) {
+        map.put(i, i);
+    }
+    ASSERT_EQ(map.size(), N);
+
+    //  0 is promoted, so 1 is evicted
+    ASSERT_EQ(map.get(0).value(), 0);
+    map.put(-1, -1);
+    ASSERT_EQ(map.size(), N);
+    ASSERT_FALSE(map.exists(1));
+    ASSERT_TRUE(map.exists(0));
+
+    auto all = entries(map);
+    ASSERT_EQ(all.front().first, -1);
+    ASSERT_EQ(all[1].first, 0);
+    ASSERT_EQ(all.back().first, 2);
+
+    //  a const find() does not promote
+    const auto & view = map;
+    ASSERT_EQ(view.find(2)->second, 2);
+    ASSERT_EQ(std::prev(map.end())->first, 2);
+
+    ASSERT_TRUE(map.erase(2));
+    ASSERT_FALSE(map.erase(2));
+    ASSERT_EQ(map.find(2), map.end());
+    ASSERT_EQ(map.size(), N - 1);
+}
+
+TEST(StaticEvictingCacheMapTest, LruOrderLinear) {
+    checkLruOrder<6>();
+}
+
+TEST(StaticEvictingCacheMapTest, LruOrderHashed) {
+    checkLruOrder<64>();
+}
+
+//  same operations on an EvictingCacheMap, which must end in the same state
+template <std::size_t N>
+static void checkAgainstEvictingCacheMap(int keys) {
+    StaticEvictingCacheMap<int, int, N> map;
+    EvictingCacheMap<int, int> reference(N);
+
+    std::uint64_t seed = 7;
+    auto random = [&seed]() {
+        seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+        return static_cast<int>(seed >> 33);
+    };
+
+    for (int i = 0; i < 100000; ++i) {
+        auto key = random() % keys;
+        switch (random() % 8) {
+            case 0:
+                ASSERT_EQ(map.erase(key), reference.erase(key));
+                break;
+            case 1:
+            case 2:
+            case 3:
+                ASSERT_EQ(map.get(key), reference.get(key));
+                break;
+            default:
+                map.put(key, i);
+                reference.put(key, i);
+        }
+        ASSERT_EQ(map.size(), reference.size());
+    }
+
+    ASSERT_EQ(entries(map), entries(reference));
+}
+
+TEST(StaticEvictingCacheMapTest, SameAsEvictingCacheMapLinear) {
+    checkAgainstEvictingCacheMap<8>(12);
+}
+
+TEST(StaticEvictingCacheMapTest, SameAsEvictingCacheMapHashed) {
+    checkAgainstEvictingCacheMap<254>(400);
+}
+
+TEST(StaticEvictingCacheMapTest, SameAsEvictingCacheMapWideIndex) {
+    checkAgainstEvictingCacheMap<300>(500);
+}
+
+TEST(StaticEvictingCacheMapTest, DestroysEntries) {
+    auto value = std::make_shared<int>(0);
+    {
+        StaticEvictingCacheMap<string, std::shared_ptr<int>, 32> map;
+        for (int i = 0; i < 100; ++i) {
+            map.put(std::to_string(i), value);
+        }
+        ASSERT_EQ(value.use_count(), 33);
+
+        map.erase("99");
+        ASSERT_EQ(value.use_count(), 32);
+
+        map.put("x", std::shared_ptr<int>());
+        map.put("y", std::shared_ptr<int>());
+        ASSERT_EQ(value.use_count(), 31);
+    }
+    ASSERT_EQ(value.use_count(), 1);
+
+    StaticEvictingCacheMap<string, std::shared_ptr<int>, 4> map;
+    map.put("a", value);
+    map.put("b", value);
+    map.clear();
+    ASSERT_TRUE(map.empty());
+    ASSERT_EQ(value.use_count(), 1);
+    ASSERT_EQ(map.begin(), map.end());
+}
+
+TEST(StaticEvictingCacheMapTest, CopyAndMove) {
+    StaticEvictingCacheMap<string, string, 20> map;
+    for (int i = 0; i < 30; ++i) {
+        map.put(std::to_string(i), string(40, 'a' + i % 26));
+    }
+    map.get("15");
+
+    auto copy = map;
+    ASSERT_TRUE(std::equal(map.begin(), map.end(), copy.begin(), copy.end()));
+
+    auto moved = std::move(copy);
+    ASSERT_TRUE(copy.empty());
+    ASSERT_TRUE(std::equal(map.begin(), map.end(), moved.begin(), moved.end()));
+    ASSERT_EQ(moved.begin()->first, "15");
+
+    copy = moved;
+    moved = std::move(copy);
+    ASSERT_TRUE(std::equal(map.begin(), map.end(), moved.begin(), moved.end()));
+    ASSERT_EQ(std::prev(moved.end())->first, "10");
+}
+
+TEST(StaticEvictingCacheMapTest, TryEmplaceAndPeek) {
+    StaticEvictingCacheMap<int, string, 2> map;
+    ASSERT_TRUE(map.try_emplace(1, 3, 'x').second);
+    ASSERT_FALSE(map.try_emplace(1, 3, 'y').second);
+    ASSERT_EQ(*map.peek(1), "xxx");
+
+    map.put(2, "b");
+    ASSERT_EQ(map.peek(3), nullptr);
+
+    //  peek() does not promote: 1 is evicted
+    map.peek(1);
+    auto result = map.try_emplace(3, "c");
+    ASSERT_TRUE(result.second);
+    ASSERT_EQ(result.first->second, "c");
+    ASSERT_FALSE(map.exists(1));
+}
+
+struct Fragile {
+    explicit Fragile(int v) {
+        if (v < 0)
+            throw std::runtime_error("cannot build");
+    }
+};
+
+TEST(StaticEvictingCacheMapTest, ConstructorThrows) {
+    StaticEvictingCacheMap<int, Fragile, 2> map;
+    map.try_emplace(1, 1);
+    map.try_emplace(2, 2);
+
+    //  the victim is gone, its slot is free for the next entry
+    ASSERT_THROW(map.try_emplace(3, -1), std::runtime_error);
+    ASSERT_EQ(map.size(), 1u);
+    ASSERT_FALSE(map.exists(1));
+
+    map.try_emplace(4, 4);
+    map.try_emplace(5, 5);
+    ASSERT_EQ(map.size(), 2u);
+    ASSERT_TRUE(map.exists(4));
+    ASSERT_TRUE(map.exists(5));
+}
@@ -0,0 +1,26 @@
+#include <atomic>
+#include <stdexcept>
+
+#include <gtest/gtest.h>
+
+#include <ThreadPool.h>
+
+TEST(ThreadPoolTest, RunsEveryTask) {
+    std::atomic<int> done(0);
+    {
+        ThreadPool pool(3);
+        ASSERT_EQ(pool.threadCount(), 3u);
+
+        for (int i = 0; i < 100; ++i) {
+            pool.execute([&done] {
+                ++done;
+            });
+        }
+    }   //  drains the queue
+
+    ASSERT_EQ(done, 100);
+}
+
+TEST(ThreadPoolTest, NoThreads) {
+    ASSERT_THROW(ThreadPool(0), std::invalid_argument);
+}
@@ -0,0 +1,121 @@
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <TimerWheel.h>
+
+using std::uint32_t;
+using std::uint64_t;
+using std::vector;
+
+static constexpr const uint64_t SECOND = 1000000000ull;
+
+TEST(TimerWheelTest, FiresOnce) {
+    TimerWheel wheel;
+    wheel.start(4, 0);
+
+    wheel.schedule(0, 3 * SECOND);
+    wheel.schedule(1, 100 * SECOND);
+    wheel.schedule(2, 10000 * SECOND);
+
+    vector<uint32_t> fired;
+    auto record = [&fired](uint32_t slot) {
+        fired.push_back(slot);
+    };
+
+    wheel.advance(2 * SECOND, record);
+    ASSERT_TRUE(fired.empty());
+
+    wheel.advance(5 * SECOND, record);
+    ASSERT_EQ(fired, vector<uint32_t>({ 0 }));
+
+    wheel.advance(99 * SECOND, record);
+    wheel.advance(102 * SECOND, record);
+    ASSERT_EQ(fired, vector<uint32_t>({ 0, 1 }));
+
+    wheel.advance(100000 * SECOND, record);
+    ASSERT_EQ(fired, vector<uint32_t>({ 0, 1, 2 }));
+
+    wheel.advance(200000 * SECOND, record);
+    ASSERT_EQ(fired.size(), 3u);
+}
+
+TEST(TimerWheelTest, Cancel) {
+    TimerWheel wheel;
+    wheel.start(2, 0);
+
+    wheel.schedule(0, SECOND);
+    wheel.schedule(1, SECOND);
+    wheel.cancel(0);
+    wheel.schedule(1, 1000 * SECOND);   //  reschedule
+
+    vector<uint32_t> fired;
+    wheel.advance(10 * SECOND, [&fired](uint32_t slot) {
+        fired.push_back(slot);
+    });
+
+    ASSERT_TRUE(fired.empty());
+    ASSERT_EQ(wheel.expiry(0), TimerWheel::NEVER);
+    ASSERT_EQ(wheel.expiry(1), 1000 * SECOND);
+}
+
+TEST(TimerWheelTest, NeverEarlyNeverLost) {
+    const uint32_t size = 2000;
+
+    TimerWheel wheel;
+    wheel.start(size, 0);
+
+    std::mt19937_64 random(1);
+
+    for (uint32_t slot = 0; slot < size; ++slot) {
+        wheel.schedule(slot, random() % (3 * 24 * 3600 * SECOND));
+    }
+
+    vector<uint64_t> expiries(size);
+    for (uint32_t slot = 0; slot < size; ++slot) {
+        expiries[slot] = wheel.expiry(slot);
+    }
+
+    uint64_t time = 0;
+    size_t count = 0;
+    while (count < size) {
+        time += random() % (3600 * SECOND);
+        wheel.advance(time, [&](uint32_t slot) {
+            ASSERT_LE(expiries[slot], time);
+            ++count;
+        });
+        wheel.sweep([&](uint32_t slot) {
+            ASSERT_LE(expiries[slot], time);
+            ++count;
+        });
+
+        //  everything due has fired
+        for (uint32_t slot = 0; slot < size; ++slot) {
+            if (expiries[slot] <= time) {
+                ASSERT_EQ(wheel.expiry(slot), TimerWheel::NEVER);
+            }
+        }
+    }
+}
+
+TEST(TimerWheelTest, Renumber) {
+    TimerWheel wheel;
+    wheel.start(4, 0);
+
+    wheel.schedule(1, SECOND);
+    wheel.schedule(3, 2 * SECOND);
+
+    wheel.renumber(2, [](uint32_t slot) {
+        return slot / 2;
+    });
+    ASSERT_EQ(wheel.expiry(0), SECOND);
+    ASSERT_EQ(wheel.expiry(1), 2 * SECOND);
+
+    vector<uint32_t> fired;
+    wheel.advance(10 * SECOND, [&fired](uint32_t slot) {
+        fired.push_back(slot);
+    });
+    ASSERT_EQ(fired, vector<uint32_t>({ 0, 1 }));
+}
@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <EvictingCacheMap.h>
+#include <MissRatioCurve.h>
+
+//  Miss ratio curve of an LRU cache over a key trace, one key per line, in a
+//  single pass.  The curve is printed as CSV, at the given capacities or at
+//  four points per doubling up to the number of distinct keys.  --verify
+//  replays the trace through EvictingCacheMap at some capacities in the same
+//  pass and prints the replayed miss ratios next to the predicted ones.
+
+namespace {
+
+const char * const USAGE =
+        "usage: mrc_lru [--rate R] [--capacities C,...] [--verify C,...] TRACE\n"
+        "  TRACE           file with one key per line, - for the standard input\n"
+        "  --rate R        follow a share R in (0, 1] of the keys (SHARDS)\n"
+        "  --capacities    capacities to print the miss ratio of\n"
+        "  --verify        capacities to replay through EvictingCacheMap\n";
+
+struct Options final {
+    double rate = 1.0;
+    std::vector<std::size_t> capacities;
+    std::vector<std::size_t> verified;
+    std::string trace;
+};
+
+struct Replay final {
+    explicit Replay(std::size_t capacity)
+            : capacity(capacity), map(capacity) {
+    }
+
+    std::size_t capacity;
+    EvictingCacheMap<std::uint64_t, char> map;
+    std::uint64_t misses = 0;
+};
+
+std::vector<std::size_t> parseCapacities(const std::string & list) {
+    std::vector<std::size_t> result;
+
+    std::size_t begin = 0;
+    while (begin <= list.size()) {
+        auto end = std::min(list.find(',', begin), list.size());
+        result.push_back(std::stoull(list.substr(begin, end - begin)));
+        begin = end + 1;
+    }
+
+    return result;
+}
+
+Options parseOptions(int argc, char * argv[]) {
+    Options options;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (argument == "--rate" && hasValue)
+            options.rate = std::stod(argv[++i]);
+        else if (argument == "--capacities" && hasValue)
+            options.capacities = parseCapacities(argv[++i]);
+        else if (argument == "--verify" && hasValue)
+            options.verified = parseCapacities(argv[++i]);
+        else if (options.trace.empty() && (argument == "-" || argument.compare(0, 2, "--") != 0))
+            options.trace = argument;
+        else
+            throw std::invalid_argument("unexpected argument " + argument);
+    }
+
+    if (options.trace.empty())
+        throw std::invalid_argument("no trace");
+
+    return options;
+}
+
+//  64-bit FNV-1a: the curve and the replays see the keys by this id
+std::uint64_t keyId(std::string_view key) {
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : key) {
+        hash = (hash ^ c) * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+std::vector<std::size_t> defaultCapacities(std::size_t distinctKeys) {
+    std::vector<std::size_t> result;
+
+    double capacity = 1.0;
+    while (result.empty() || result.back() < distinctKeys) {
+        auto rounded = static_cast<std::size_t>(capacity + 0.5);
+        if (result.empty() || rounded > result.back())
+            result.push_back(rounded);
+        capacity *= 1.189207115;    //  2^(1/4)
+    }
+
+    return result;
+}
+
+void run(const Options & options, std::istream & trace) {
+    auto start = std::chrono::steady_clock::now();
+
+    MissRatioCurve curve(options.rate);
+    std::vector<Replay> replays(options.verified.begin(), options.verified.end());
+
+    std::string line;
+    while (std::getline(trace, line)) {
+        std::string_view key = line;
+        if (!key.empty() && key.back() == '\r')
+            key.remove_suffix(1);
+        if (key.empty())
+            continue;
+
+        auto id = keyId(key);
+        curve.access(id);
+
+        for (auto & replay : replays) {
+            if (replay.map.find(id) == replay.map.end()) {
+                ++replay.misses;
+                replay.map.put(id, 0);
+            }
+        }
+    }
+
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << curve.accesses() << " accesses, about " << curve.distinctKeys()
+              << " distinct keys, sampling rate " << curve.rate()
+              << ", " << seconds << " s" << std::endl;
+
+    auto capacities = options.capacities.empty()
+            ? defaultCapacities(curve.distinctKeys())
+            : options.capacities;
+
+    std::cout << "capacity,miss_ratio\n";
+    for (auto capacity : capacities) {
+        std::cout << capacity << ',' << curve.missRatio(capacity) << '\n';
+    }
+
+    if (replays.empty())
+        return;
+
+    std::cout << "\ncapacity,predicted,replayed\n";
+    for (auto & replay : replays) {
+        auto replayed = (curve.accesses() == 0)
+                ? 0.0
+                : static_cast<double>(replay.misses) / curve.accesses();
+        std::cout << replay.capacity << ',' << curve.missRatio(replay.capacity)
+                  << ',' << replayed << '\n';
+    }
+}
+
+}   //  namespace
+
+int main(int argc, char * argv[]) {
+    Options options;
+    try {
+        options = parseOptions(argc, argv);
+    } catch (const std::exception & e) {
+        std::cerr << "mrc_lru: " << e.what() << '\n' << USAGE;
+        return 2;
+    }
+
+    try {
+        if (options.trace == "-") {
+            run(options, std::cin);
+        } else {
+            std::ifstream file(options.trace);
+            if (!file)
+                throw std::runtime_error("cannot open " + options.trace + ": " + std::strerror(errno));
+
+            run(options, file);
+        }
+    } catch (const std::exception & e) {
+        std::cerr << "mrc_lru: " << e.what() << '\n';
+        return 1;
+    }
+
+    return 0;
+}